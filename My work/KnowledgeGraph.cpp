@@ -1,5 +1,188 @@
 #include "KnowledgeGraph.h"
 
+#include <charconv>
+#include <climits>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>
+#endif
+
+// =============================================================================
+// Class WorkerPool Implementation
+// =============================================================================
+
+WorkerPool::WorkerPool()
+    : jobNumber(0), jobHelpers(0), pending(0), stopping(false), body(nullptr), count(0), block(1), next(0)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> guard(this->jobLock);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for (thread &helper : this->helpers)
+        helper.join();
+}
+
+void WorkerPool::work(int id)
+{
+    while (true)
+    {
+        size_t begin = this->next.fetch_add(this->block);
+        if (begin >= this->count)
+            break;
+        (*this->body)(begin, min(this->count, begin + this->block), id);
+    }
+}
+
+// Helper id (1-based) waits for each new job and joins it if the job asked
+// for that many helpers. run() does not return before every helper it
+// counted has finished, so a taking-part helper never misses its job.
+void WorkerPool::helperLoop(int id)
+{
+    unsigned long long seen = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> guard(this->jobLock);
+            this->wake.wait(guard, [&]()
+                            { return this->stopping || this->jobNumber != seen; });
+            if (this->stopping)
+                return;
+            seen = this->jobNumber;
+            if (id > this->jobHelpers)
+                continue;
+        }
+
+        this->work(id);
+
+        lock_guard<mutex> guard(this->jobLock);
+        if (--this->pending == 0)
+            this->finished.notify_one();
+    }
+}
+
+void WorkerPool::run(int threads, size_t count, const Body &body, size_t block)
+{
+    if (threads <= 1 || count <= block)
+    {
+        body(0, count, 0);
+        return;
+    }
+
+    lock_guard<mutex> serial(this->runLock);
+    {
+        lock_guard<mutex> guard(this->jobLock);
+        while ((int)this->helpers.size() < threads - 1)
+            this->helpers.emplace_back(&WorkerPool::helperLoop, this, (int)this->helpers.size() + 1);
+
+        this->body = &body;
+        this->count = count;
+        this->block = block;
+        this->next.store(0, memory_order_relaxed);
+        this->jobHelpers = threads - 1;
+        this->pending = threads - 1;
+        this->jobNumber++;
+    }
+    this->wake.notify_all();
+
+    this->work(0);
+
+    unique_lock<mutex> guard(this->jobLock);
+    this->finished.wait(guard, [&]()
+                        { return this->pending == 0; });
+    this->body = nullptr;
+}
+
+// =============================================================================
+// Class TextWriter Implementation
+// =============================================================================
+
+TextWriter::TextWriter(ostream *sink, size_t chunkSize) : sink(sink), chunkSize(chunkSize) {}
+
+TextWriter::~TextWriter()
+{
+    if (this->sink != nullptr)
+        this->flush();
+}
+
+void TextWriter::appendInt(long long value)
+{
+    char digits[24];
+    char *end = to_chars(digits, digits + sizeof(digits), value).ptr;
+    this->buffer.append(digits, end - digits);
+}
+
+void TextWriter::appendFixed(float value)
+{
+    // Fixed notation of FLT_MAX needs 46 characters
+    char digits[64];
+    char *end = to_chars(digits, digits + sizeof(digits), value, chars_format::fixed, 6).ptr;
+    this->buffer.append(digits, end - digits);
+}
+
+void TextWriter::appendGeneral(float value)
+{
+    char digits[32];
+    char *end = to_chars(digits, digits + sizeof(digits), value, chars_format::general, 6).ptr;
+    this->buffer.append(digits, end - digits);
+}
+
+void TextWriter::flush()
+{
+    if (this->sink == nullptr || this->buffer.empty())
+        return;
+
+    this->sink->write(this->buffer.data(), this->buffer.size());
+    this->buffer.clear();
+}
+
+// Vertex values print as ostream << vertex would
+static void writeValue(TextWriter &out, const string &value)
+{
+    out.append(value);
+}
+
+static void writeValue(TextWriter &out, int value)
+{
+    out.appendInt(value);
+}
+
+static void writeValue(TextWriter &out, float value)
+{
+    out.appendGeneral(value);
+}
+
+static void writeValue(TextWriter &out, char value)
+{
+    out.put(value);
+}
+
+template <class U>
+static void writeValue(TextWriter &out, const U &value)
+{
+    stringstream ss;
+    ss << value;
+    out.append(ss.str());
+}
+
 // =============================================================================
 // Class Edge Implementation
 // =============================================================================
@@ -10,6 +193,10 @@ Edge<T>::Edge()
     this->from = nullptr;
     this->to = nullptr;
     this->weight = 0.0f;
+    this->outSeq = 0;
+    this->inSeq = 0;
+    this->outPos = 0;
+    this->inPos = 0;
 }
 
 // TODO: Implement other methods of Edge:
@@ -20,6 +207,10 @@ Edge<T>::Edge(VertexNode<T> *from, VertexNode<T> *to, float weight)
     this->from = from;
     this->to = to;
     this->weight = weight;
+    this->outSeq = 0;
+    this->inSeq = 0;
+    this->outPos = 0;
+    this->inPos = 0;
 }
 
 template <class T>
@@ -41,20 +232,23 @@ bool Edge<T>::edgeEQ(Edge<T> *&edge1, Edge<T> *&edge2)
 template <class T>
 string Edge<T>::toString()
 {
-    string fromStr;
-    string toStr;
+    TextWriter out;
+    this->writeTo(out);
+    return std::move(out.str());
+}
 
+template <class T>
+void Edge<T>::writeTo(TextWriter &out)
+{
+    out.put('(');
     if (from != nullptr && from->vertex2str != nullptr)
-        fromStr = from->vertex2str(from->vertex);
-    else
-        fromStr = "";
-
+        out.append(from->vertex2str(from->vertex));
+    out.append(", ");
     if (to != nullptr && to->vertex2str != nullptr)
-        toStr = to->vertex2str(to->vertex);
-    else
-        toStr = "";
-
-    return "(" + fromStr + ", " + toStr + ", " + to_string(weight) + ")";
+        out.append(to->vertex2str(to->vertex));
+    out.append(", ");
+    out.appendFixed(weight);
+    out.put(')');
 }
 
 // =============================================================================
@@ -64,11 +258,16 @@ string Edge<T>::toString()
 template <class T>
 VertexNode<T>::VertexNode(T vertex, bool (*vertexEQ)(T &, T &), string (*vertex2str)(T &))
 {
-    this->vertex = vertex;
+    this->vertex = std::move(vertex);
     this->vertexEQ = vertexEQ;
     this->vertex2str = vertex2str;
+    this->id = -1;
+    this->graph = nullptr;
     this->inDegree_ = 0;
     this->outDegree_ = 0;
+    this->adCount = 0;
+    this->outHoles = 0;
+    this->inHoles = 0;
 }
 
 template <class T>
@@ -81,22 +280,66 @@ template <class T>
 void VertexNode<T>::connect(VertexNode<T> *to, float weight)
 {
     // TODO: Connect this vertex to the 'to' vertex
-    Edge<T> *newEdge = new Edge<T>(this, to, weight);
+    Edge<T> *newEdge;
+    if (this->graph != nullptr)
+    {
+        DGraphModel<T> *g = this->graph;
+        unsigned long long key = EdgeIndex<T>::keyOf(this->id, to->id);
+        typename EdgeIndex<T>::Slot *slot = g->edgeIndex.find(key);
+        if (slot != nullptr)
+        {
+            if (g->edgePolicy == REJECT_DUPLICATES)
+                throw DuplicateEdgeException();
+            if (g->edgePolicy == OVERWRITE_WEIGHT)
+            {
+                slot->first->weight = weight;
+                g->generation++;
+                for (GraphObserver *observer : g->observers)
+                    observer->weightChanged(this->id, to->id, weight);
+                return;
+            }
+        }
 
-    // Update adjacency list
-    this->adList.push_back(newEdge);
-    to->adList.push_back(newEdge);
+        newEdge = g->edgePool.create(this, to, weight);
+        if (slot != nullptr)
+            slot->count++;
+        else
+            g->edgeIndex.insert(key, newEdge);
+    }
+    else
+        newEdge = new Edge<T>(this, to, weight);
+
+    // Update adjacency lists
+    newEdge->outSeq = this->adCount++;
+    newEdge->inSeq = to->adCount++;
+    newEdge->outPos = this->outList.size();
+    newEdge->inPos = to->inList.size();
+    this->outList.push_back(newEdge);
+    to->inList.push_back(newEdge);
 
     // Update data
     this->outDegree_++;
     to->inDegree_++;
+
+    if (this->graph != nullptr)
+    {
+        this->graph->generation++;
+        for (GraphObserver *observer : this->graph->observers)
+            observer->edgeAdded(this->id, to->id, weight);
+    }
 }
 
 template <class T>
 Edge<T> *VertexNode<T>::getEdge(VertexNode<T> *to)
 {
-    for (Edge<T> *edge : this->adList)
-        if (edge != nullptr && edge->to == to && edge->from == this)
+    if (this->graph != nullptr)
+    {
+        typename EdgeIndex<T>::Slot *slot = this->graph->edgeIndex.find(EdgeIndex<T>::keyOf(this->id, to->id));
+        return slot != nullptr ? slot->first : nullptr;
+    }
+
+    for (Edge<T> *edge : this->outEdges())
+        if (edge->to == to)
             return edge;
     return nullptr;
 }
@@ -114,37 +357,86 @@ bool VertexNode<T>::equals(VertexNode<T> *node)
 }
 
 template <class T>
-void VertexNode<T>::removeTo(VertexNode<T> *to)
+void VertexNode<T>::detachOut(Edge<T> *edge)
 {
-    Edge<T> *edge = this->getEdge(to);
-    if (edge == nullptr)
+    this->outList[edge->outPos] = nullptr;
+    this->outDegree_--;
+    if (++this->outHoles * 2 <= (int)this->outList.size())
         return;
 
-    // Update adjacency list
-    for (auto it = this->adList.begin(); it != this->adList.end(); ++it)
+    int kept = 0;
+    for (Edge<T> *live : this->outList)
     {
-        if (*it == edge)
-        {
-            this->adList.erase(it);
-            break;
-        }
+        if (live == nullptr)
+            continue;
+        live->outPos = kept;
+        this->outList[kept++] = live;
+    }
+    this->outList.resize(kept);
+    this->outHoles = 0;
+}
+
+template <class T>
+void VertexNode<T>::detachIn(Edge<T> *edge)
+{
+    this->inList[edge->inPos] = nullptr;
+    this->inDegree_--;
+    if (++this->inHoles * 2 <= (int)this->inList.size())
+        return;
+
+    int kept = 0;
+    for (Edge<T> *live : this->inList)
+    {
+        if (live == nullptr)
+            continue;
+        live->inPos = kept;
+        this->inList[kept++] = live;
     }
+    this->inList.resize(kept);
+    this->inHoles = 0;
+}
+
+template <class T>
+void VertexNode<T>::removeTo(VertexNode<T> *to)
+{
+    Edge<T> *edge = this->getEdge(to);
+    if (edge == nullptr)
+        return;
 
-    for (auto it = to->adList.begin(); it != to->adList.end(); ++it)
+    if (this->graph != nullptr)
     {
-        if (*it == edge)
+        // A parallel edge, if any, becomes the indexed one. Later edges sit
+        // after this one in outList, so the search starts there.
+        DGraphModel<T> *g = this->graph;
+        typename EdgeIndex<T>::Slot *slot = g->edgeIndex.find(EdgeIndex<T>::keyOf(this->id, to->id));
+        if (--slot->count == 0)
+            g->edgeIndex.erase(slot);
+        else
         {
-            to->adList.erase(it);
-            break;
+            for (size_t i = edge->outPos + 1; i < this->outList.size(); ++i)
+            {
+                if (this->outList[i] != nullptr && this->outList[i]->to == to)
+                {
+                    slot->first = this->outList[i];
+                    break;
+                }
+            }
         }
     }
 
-    // Update data
-    this->outDegree_--;
-    to->inDegree_--;
+    this->detachOut(edge);
+    to->detachIn(edge);
 
     // Delete edge
-    delete edge;
+    if (this->graph != nullptr)
+    {
+        this->graph->edgePool.destroy(edge);
+        this->graph->generation++;
+        for (GraphObserver *observer : this->graph->observers)
+            observer->edgeRemoved(this->id, to->id);
+    }
+    else
+        delete edge;
 }
 
 template <class T>
@@ -162,32 +454,163 @@ int VertexNode<T>::outDegree()
 template <class T>
 string VertexNode<T>::toString()
 {
-    stringstream ss;
-    ss << "(" << vertex << ", "
-       << this->inDegree() << ", "
-       << this->outDegree() << ", [";
+    TextWriter out;
+    this->writeTo(out);
+    return std::move(out.str());
+}
 
-    for (size_t i = 0; i < adList.size(); ++i)
+template <class T>
+void VertexNode<T>::writeTo(TextWriter &out)
+{
+    out.put('(');
+    writeValue(out, vertex);
+    out.append(", ");
+    out.appendInt(this->inDegree());
+    out.append(", ");
+    out.appendInt(this->outDegree());
+    out.append(", [");
+
+    // Merge both lists back into attachment order
+    size_t i = 0, j = 0;
+    bool first = true;
+    while (true)
     {
-        ss << adList[i]->toString();
-        if (i + 1 < adList.size())
-            ss << ", ";
+        while (i < outList.size() && outList[i] == nullptr)
+            ++i;
+        while (j < inList.size() && inList[j] == nullptr)
+            ++j;
+        if (i == outList.size() && j == inList.size())
+            break;
+
+        Edge<T> *edge;
+        if (j == inList.size() || (i < outList.size() && outList[i]->outSeq < inList[j]->inSeq))
+            edge = outList[i++];
+        else
+            edge = inList[j++];
+
+        if (!first)
+            out.append(", ");
+        edge->writeTo(out);
+        first = false;
     }
 
-    ss << "])";
-    return ss.str();
+    out.append("])");
 }
 
 template <class T>
 std::vector<Edge<T> *> VertexNode<T>::getOutwardEdges()
 {
-    vector<Edge<T> *> out;
-    for (Edge<T> *edge : this->adList)
+    vector<Edge<T> *> edges;
+    edges.reserve(this->outDegree_);
+    for (Edge<T> *edge : this->outEdges())
+        edges.push_back(edge);
+    return edges;
+}
+
+// =============================================================================
+// Class DFSWalker Implementation
+// =============================================================================
+
+template <class T>
+DFSWalker<T>::DFSWalker()
+{
+    this->pending = nullptr;
+}
+
+template <class T>
+void DFSWalker<T>::start(VertexNode<T> *startNode, int idBound)
+{
+    this->visited.reset(idBound);
+    this->stack.clear();
+    this->pending = startNode;
+}
+
+template <class T>
+VertexNode<T> *DFSWalker<T>::next()
+{
+    // The start vertex is emitted before any frame exists
+    if (this->pending != nullptr)
     {
-        if (edge != nullptr && edge->from == this)
-            out.push_back(edge);
+        VertexNode<T> *u = this->pending;
+        this->pending = nullptr;
+        this->visited.mark(u->id);
+        this->stack.push_back(make_pair(u, 0));
+        return u;
     }
-    return out;
+
+    while (!this->stack.empty())
+    {
+        pair<VertexNode<T> *, int> &top = this->stack.back();
+        if (top.second == (int)top.first->outList.size())
+        {
+            this->stack.pop_back();
+            continue;
+        }
+
+        Edge<T> *edge = top.first->outList[top.second++];
+        if (edge == nullptr)
+            continue;
+
+        VertexNode<T> *v = edge->getTo();
+        if (this->visited.mark(v->id))
+        {
+            this->stack.push_back(make_pair(v, 0));
+            return v;
+        }
+    }
+    return nullptr;
+}
+
+template <class T>
+bool DFSWalker<T>::done()
+{
+    return (this->pending == nullptr && this->stack.empty());
+}
+
+template <class T>
+int DFSWalker<T>::depth()
+{
+    return this->stack.size();
+}
+
+// =============================================================================
+// Class GraphChangeLog Implementation
+// =============================================================================
+
+void GraphChangeLog::vertexAdded(int id)
+{
+    this->changes.push_back(GraphChange(GraphChange::VERTEX_ADDED, id));
+}
+
+void GraphChangeLog::vertexRemoved(int id)
+{
+    this->changes.push_back(GraphChange(GraphChange::VERTEX_REMOVED, id));
+}
+
+void GraphChangeLog::edgeAdded(int from, int to, float weight)
+{
+    this->changes.push_back(GraphChange(GraphChange::EDGE_ADDED, from, to, weight));
+}
+
+void GraphChangeLog::edgeRemoved(int from, int to)
+{
+    this->changes.push_back(GraphChange(GraphChange::EDGE_REMOVED, from, to));
+}
+
+void GraphChangeLog::weightChanged(int from, int to, float weight)
+{
+    this->changes.push_back(GraphChange(GraphChange::WEIGHT_CHANGED, from, to, weight));
+}
+
+void GraphChangeLog::graphCleared()
+{
+    this->changes.push_back(GraphChange(GraphChange::CLEARED));
+}
+
+void GraphChangeLog::drain(vector<GraphChange> &out)
+{
+    out.clear();
+    out.swap(this->changes);
 }
 
 // =============================================================================
@@ -195,36 +618,70 @@ std::vector<Edge<T> *> VertexNode<T>::getOutwardEdges()
 // =============================================================================
 
 template <class T>
-DGraphModel<T>::DGraphModel(bool (*vertexEQ)(T &, T &), string (*vertex2str)(T &))
+DGraphModel<T>::DGraphModel(bool (*vertexEQ)(T &, T &), string (*vertex2str)(T &), size_t (*vertexHash)(T &))
 {
     this->vertexEQ = vertexEQ;
     this->vertex2str = vertex2str;
+    this->vertexHash = vertexHash;
+    this->liveCount = 0;
+    this->edgePolicy = KEEP_MULTI_EDGES;
+    this->generation = 0;
 }
 
 template <class T>
 DGraphModel<T>::~DGraphModel()
 {
     // TODO: Clear all vertices and edges to avoid memory leaks
+    this->observers.clear();
     this->clear();
 }
 
 // TODO: Implement other methods of DGraphModel:
 
+template <class T>
+bool DGraphModel<T>::isIndexed()
+{
+    // A custom vertexEQ without a matching hasher may group values that
+    // std::hash keeps apart, so only the linear scan is safe in that case
+    return (this->vertexEQ == nullptr || this->vertexHash != nullptr);
+}
+
+template <class T>
+size_t DGraphModel<T>::hashOf(T &vertex)
+{
+    if (this->vertexHash != nullptr)
+        return this->vertexHash(vertex);
+
+    return std::hash<T>()(vertex);
+}
+
+template <class T>
+bool DGraphModel<T>::matches(VertexNode<T> *node, T &vertex)
+{
+    if (this->vertexEQ != nullptr)
+        return this->vertexEQ(node->vertex, vertex);
+
+    return node->vertex == vertex;
+}
+
 template <class T>
 VertexNode<T> *DGraphModel<T>::getVertexNode(T &vertex)
 {
-    for (VertexNode<T> *current : this->nodeList)
+    if (this->isIndexed())
     {
-        if (this->vertexEQ != nullptr)
-        {
-            if (this->vertexEQ(current->vertex, vertex))
-                return current;
-        }
-        else
+        auto range = this->nodeIndex.equal_range(this->hashOf(vertex));
+        for (auto it = range.first; it != range.second; ++it)
         {
-            if (current->vertex == vertex)
-                return current;
+            if (this->matches(it->second, vertex))
+                return it->second;
         }
+        return nullptr;
+    }
+
+    for (VertexNode<T> *current : this->nodeList)
+    {
+        if (current != nullptr && this->matches(current, vertex))
+            return current;
     }
     return nullptr;
 }
@@ -251,41 +708,199 @@ void DGraphModel<T>::add(T vertex)
     if (this->contains(vertex))
         return;
 
-    VertexNode<T> *newNode = new VertexNode<T>(vertex, this->vertexEQ, this->vertex2str);
+    VertexNode<T> *newNode = this->nodePool.create(std::move(vertex), this->vertexEQ, this->vertex2str);
+    newNode->id = this->nodeList.size();
+    newNode->graph = this;
 
     // Add
     this->nodeList.push_back(newNode);
+    this->liveCount++;
+    if (this->isIndexed())
+        this->nodeIndex.emplace(this->hashOf(newNode->vertex), newNode);
+    this->generation++;
+    for (GraphObserver *observer : this->observers)
+        observer->vertexAdded(newNode->id);
 }
 
 template <class T>
-bool DGraphModel<T>::contains(T vertex)
+void DGraphModel<T>::remove(T vertex)
 {
-    for (VertexNode<T> *current : this->nodeList)
-    {
-        if (this->vertexEQ != nullptr)
-        {
-            if (this->vertexEQ(current->vertex, vertex))
-                return true;
-        }
-        else
-        {
-            if (current->vertex == vertex)
-                return true;
-        }
-    }
-    return false;
+    VertexNode<T> *node = this->getVertexNode(vertex);
+    if (node == nullptr)
+        throw VertexNotFoundException();
+
+    this->removeNode(node);
 }
 
 template <class T>
-float DGraphModel<T>::weight(T from, T to)
+void DGraphModel<T>::removeNode(VertexNode<T> *node)
 {
-    // Find vertex from and to
-    VertexNode<T> *fromNode = this->getVertexNode(from);
-    VertexNode<T> *toNode = this->getVertexNode(to);
+    // Outgoing edges, self-loops included. A self-loop's slot in node's own
+    // inList is cleared directly so the second pass skips it.
+    for (Edge<T> *edge : node->outList)
+    {
+        if (edge == nullptr)
+            continue;
 
-    // Throw exception
-    if (fromNode == nullptr || toNode == nullptr)
-        throw VertexNotFoundException();
+        if (edge->to == node)
+            node->inList[edge->inPos] = nullptr;
+        else
+            edge->to->detachIn(edge);
+
+        if (typename EdgeIndex<T>::Slot *slot = this->edgeIndex.find(EdgeIndex<T>::keyOf(node->id, edge->to->id)))
+            this->edgeIndex.erase(slot);
+        for (GraphObserver *observer : this->observers)
+            observer->edgeRemoved(node->id, edge->to->id);
+        this->edgePool.destroy(edge);
+    }
+
+    for (Edge<T> *edge : node->inList)
+    {
+        if (edge == nullptr)
+            continue;
+
+        edge->from->detachOut(edge);
+        if (typename EdgeIndex<T>::Slot *slot = this->edgeIndex.find(EdgeIndex<T>::keyOf(edge->from->id, node->id)))
+            this->edgeIndex.erase(slot);
+        for (GraphObserver *observer : this->observers)
+            observer->edgeRemoved(edge->from->id, node->id);
+        this->edgePool.destroy(edge);
+    }
+
+    if (this->isIndexed())
+    {
+        auto range = this->nodeIndex.equal_range(this->hashOf(node->vertex));
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second == node)
+            {
+                this->nodeIndex.erase(it);
+                break;
+            }
+        }
+    }
+
+    int id = node->id;
+    this->nodeList[id] = nullptr;
+    this->liveCount--;
+    this->nodePool.destroy(node);
+    this->generation++;
+    for (GraphObserver *observer : this->observers)
+        observer->vertexRemoved(id);
+}
+
+template <class T>
+bool DGraphModel<T>::contains(T vertex)
+{
+    return (this->getVertexNode(vertex) != nullptr);
+}
+
+template <class T>
+void DGraphModel<T>::reserve(int vertexCount)
+{
+    this->nodeList.reserve(vertexCount);
+    if (this->isIndexed())
+        this->nodeIndex.reserve(vertexCount);
+}
+
+template <class T>
+void DGraphModel<T>::addAll(const vector<T> &vertices)
+{
+    this->reserve(this->nodeList.size() + vertices.size());
+
+    // add() already skips vertices that exist, including earlier batch entries
+    for (const T &vertex : vertices)
+        this->add(vertex);
+}
+
+template <class T>
+void DGraphModel<T>::connectAll(const vector<EdgeTriple<T>> &edges)
+{
+    vector<VertexNode<T> *> froms, tos;
+    vector<float> weights;
+    froms.reserve(edges.size());
+    tos.reserve(edges.size());
+    weights.reserve(edges.size());
+
+    int missing = 0;
+    for (const EdgeTriple<T> &edge : edges)
+    {
+        T from = edge.from;
+        T to = edge.to;
+        froms.push_back(this->getVertexNode(from));
+        tos.push_back(this->getVertexNode(to));
+        weights.push_back(edge.weight);
+
+        if (froms.back() == nullptr || tos.back() == nullptr)
+            missing++;
+    }
+
+    if (missing > 0)
+        throw VertexNotFoundException("Vertex not found! (" + to_string(missing) + " of " +
+                                      to_string(edges.size()) + " edges)");
+
+    this->connectAll(froms, tos, weights);
+}
+
+template <class T>
+void DGraphModel<T>::connectAll(const vector<VertexNode<T> *> &froms,
+                                const vector<VertexNode<T> *> &tos,
+                                const vector<float> &weights)
+{
+    if (tos.size() != froms.size() || weights.size() != froms.size())
+        throw invalid_argument("connectAll: froms, tos and weights differ in size");
+
+    for (size_t i = 0; i < froms.size(); ++i)
+    {
+        if (froms[i] == nullptr || tos[i] == nullptr)
+            throw VertexNotFoundException();
+    }
+
+    // Rejected duplicates must fail the batch before any edge is added
+    if (this->edgePolicy == REJECT_DUPLICATES)
+    {
+        unordered_set<unsigned long long> batch;
+        batch.reserve(froms.size());
+        for (size_t i = 0; i < froms.size(); ++i)
+        {
+            unsigned long long key = EdgeIndex<T>::keyOf(froms[i]->id, tos[i]->id);
+            if (this->edgeIndex.find(key) != nullptr || !batch.insert(key).second)
+                throw DuplicateEdgeException();
+        }
+    }
+    this->edgeIndex.reserve(this->edgeIndex.size() + froms.size());
+
+    // Size every adjacency list once before filling them
+    vector<int> outAdd(this->idBound(), 0), inAdd(this->idBound(), 0);
+    for (size_t i = 0; i < froms.size(); ++i)
+    {
+        outAdd[froms[i]->id]++;
+        inAdd[tos[i]->id]++;
+    }
+    for (VertexNode<T> *node : this->nodeList)
+    {
+        if (node == nullptr)
+            continue;
+        if (outAdd[node->id] > 0)
+            node->outList.reserve(node->outList.size() + outAdd[node->id]);
+        if (inAdd[node->id] > 0)
+            node->inList.reserve(node->inList.size() + inAdd[node->id]);
+    }
+
+    for (size_t i = 0; i < froms.size(); ++i)
+        froms[i]->connect(tos[i], weights[i]);
+}
+
+template <class T>
+float DGraphModel<T>::weight(T from, T to)
+{
+    // Find vertex from and to
+    VertexNode<T> *fromNode = this->getVertexNode(from);
+    VertexNode<T> *toNode = this->getVertexNode(to);
+
+    // Throw exception
+    if (fromNode == nullptr || toNode == nullptr)
+        throw VertexNotFoundException();
 
     // Find edge
     Edge<T> *edge = fromNode->getEdge(toNode);
@@ -340,6 +955,18 @@ void DGraphModel<T>::disconnect(T from, T to)
     fromNode->removeTo(toNode);
 }
 
+template <class T>
+void DGraphModel<T>::setEdgePolicy(EdgePolicy policy)
+{
+    this->edgePolicy = policy;
+}
+
+template <class T>
+EdgePolicy DGraphModel<T>::getEdgePolicy()
+{
+    return this->edgePolicy;
+}
+
 template <class T>
 bool DGraphModel<T>::connected(T from, T to)
 {
@@ -357,32 +984,75 @@ bool DGraphModel<T>::connected(T from, T to)
 template <class T>
 int DGraphModel<T>::size()
 {
-    return this->nodeList.size();
+    return this->liveCount;
 }
 
 template <class T>
 bool DGraphModel<T>::empty()
 {
-    return (this->nodeList.size() == 0);
+    return (this->liveCount == 0);
+}
+
+template <class T>
+int DGraphModel<T>::idBound()
+{
+    return this->nodeList.size();
+}
+
+template <class T>
+VertexNode<T> *DGraphModel<T>::getVertexNodeById(int id)
+{
+    if (id < 0 || id >= (int)this->nodeList.size())
+        return nullptr;
+
+    return this->nodeList[id];
+}
+
+template <class T>
+unsigned long long DGraphModel<T>::getGeneration()
+{
+    return this->generation;
+}
+
+template <class T>
+WorkerPool &DGraphModel<T>::getWorkerPool()
+{
+    return this->workerPool;
+}
+
+template <class T>
+void DGraphModel<T>::addObserver(GraphObserver *observer)
+{
+    this->observers.push_back(observer);
+}
+
+template <class T>
+void DGraphModel<T>::removeObserver(GraphObserver *observer)
+{
+    this->observers.erase(std::remove(this->observers.begin(), this->observers.end(), observer),
+                          this->observers.end());
 }
 
 template <class T>
 void DGraphModel<T>::clear()
 {
-    for (VertexNode<T> *node : nodeList)
-    {
-        for (Edge<T> *edge : node->adList)
-        {
-            if (edge != nullptr && edge->from == node)
-                delete edge;
-        }
-        node->adList.clear();
-    }
+    static_assert(std::is_trivially_destructible<Edge<T>>::value,
+                  "edges are dropped with their pool chunks");
 
-    // Delete nodes
+    // Vertices own strings/vectors and need their destructors; edges do not
     for (VertexNode<T> *node : nodeList)
-        delete node;
+        if (node != nullptr)
+            node->~VertexNode<T>();
+
     nodeList.clear();
+    liveCount = 0;
+    nodeIndex.clear();
+    edgeIndex.clear();
+    nodePool.release();
+    edgePool.release();
+    generation++;
+    for (GraphObserver *observer : observers)
+        observer->graphCleared();
 }
 
 template <class T>
@@ -417,7 +1087,8 @@ std::vector<T> DGraphModel<T>::vertices()
     vector<T> result;
 
     for (VertexNode<T> *ver : nodeList)
-        result.push_back(ver->vertex);
+        if (ver != nullptr)
+            result.push_back(ver->vertex);
 
     return result;
 }
@@ -425,421 +1096,3602 @@ std::vector<T> DGraphModel<T>::vertices()
 template <class T>
 string DGraphModel<T>::toString()
 {
-    stringstream ss;
-    ss << "[";
-
-    for (size_t i = 0; i < nodeList.size(); ++i)
-    {
-        ss << nodeList[i]->toString();
-        if (i + 1 < nodeList.size())
-            ss << ", ";
-    }
+    // Rough size: a vertex header plus two edge records per edge
+    size_t edges = 0;
+    for (VertexNode<T> *node : nodeList)
+        if (node != nullptr)
+            edges += node->outDegree_;
 
-    ss << "]";
-    return ss.str();
+    TextWriter out;
+    out.reserve(liveCount * 24 + edges * 48 + 2);
+    this->writeTo(out);
+    return std::move(out.str());
 }
 
 template <class T>
-string DGraphModel<T>::BFS(T start)
+void DGraphModel<T>::writeTo(ostream &out, size_t chunkSize)
 {
-    if (this->nodeList.size() == 0)
-        return "[]";
-
-    VertexNode<T> *startNode = this->getVertexNode(start);
-    if (startNode == nullptr)
-        throw VertexNotFoundException();
-
-    vector<VertexNode<T> *> visited;
-    vector<VertexNode<T> *> q;
-    int idx = 0;
-
-    visited.push_back(startNode);
-    q.push_back(startNode);
+    TextWriter writer(&out, chunkSize);
+    this->writeTo(writer);
+    writer.flush();
+}
 
-    stringstream ss;
-    ss << "[";
+template <class T>
+void DGraphModel<T>::writeTo(TextWriter &out)
+{
+    out.put('[');
     bool first = true;
-
-    while (idx < (int)q.size())
+    for (VertexNode<T> *node : nodeList)
     {
-        VertexNode<T> *u = q[idx++];
-
+        if (node == nullptr)
+            continue;
         if (!first)
-            ss << ", ";
-        ss << this->vertex2Str(*u);
+            out.append(", ");
+        node->writeTo(out);
         first = false;
-
-        vector<Edge<T> *> edges = u->getOutwardEdges();
-        for (Edge<T> *edge : edges)
-        {
-            VertexNode<T> *v = edge->getTo();
-
-            bool seen = false;
-            for (VertexNode<T> *x : visited)
-            {
-                if (x == v)
-                {
-                    seen = true;
-                    break;
-                }
-            }
-
-            if (!seen)
-            {
-                visited.push_back(v);
-                q.push_back(v);
-            }
-        }
+        out.flushIfFull();
     }
-
-    ss << "]";
-    return ss.str();
+    out.put(']');
 }
 
 template <class T>
-void DGraphModel<T>::DFS_helper(
-    VertexNode<T> *u,
-    vector<VertexNode<T> *> &visited,
-    stringstream &ss,
-    bool &first)
+string DGraphModel<T>::BFS(T start)
 {
-    visited.push_back(u);
+    if (this->liveCount == 0)
+        return "[]";
 
-    if (!first)
-        ss << ", ";
-    ss << this->vertex2Str(*u);
-    first = false;
+    VertexNode<T> *startNode = this->getVertexNode(start);
+    if (startNode == nullptr)
+        throw VertexNotFoundException();
 
-    vector<Edge<T> *> edges = u->getOutwardEdges();
-    for (Edge<T> *edge : edges)
-    {
-        VertexNode<T> *v = edge->getTo();
+    return this->BFSFrom(startNode);
+}
 
-        bool seen = false;
-        for (VertexNode<T> *x : visited)
-        {
-            if (x == v)
-            {
-                seen = true;
-                break;
-            }
-        }
-        if (!seen)
-            DFS_helper(v, visited, ss, first);
-    }
+template <class T>
+string DGraphModel<T>::BFSFrom(VertexNode<T> *startNode)
+{
+    this->bfsIds(startNode, this->orderScratch);
+    return this->formatIds(this->orderScratch);
 }
 
 template <class T>
 string DGraphModel<T>::DFS(T start)
 {
-    if (this->nodeList.size() == 0)
+    if (this->liveCount == 0)
         return "[]";
 
     VertexNode<T> *startNode = this->getVertexNode(start);
     if (startNode == nullptr)
         throw VertexNotFoundException();
 
-    vector<VertexNode<T> *> visited;
-    stringstream ss;
-    ss << "[";
-    bool first = true;
-
-    DFS_helper(startNode, visited, ss, first);
-
-    ss << "]";
-    return ss.str();
-}
-
-// =============================================================================
-// Class KnowledgeGraph Implementation
-// =============================================================================
-
-KnowledgeGraph::KnowledgeGraph()
-{
-    // TODO: Initialize the KnowledgeGraph
-    auto vertexEQ = [](string &a, string &b) -> bool
-    { return a == b; };
-    auto vertex2str = [](string &s) -> string
-    { return s; };
-
-    this->graph = DGraphModel<string>(vertexEQ, vertex2str);
-    this->entities = vector<string>();
+    return this->DFSFrom(startNode);
 }
 
-void KnowledgeGraph::addEntity(string entity)
+template <class T>
+string DGraphModel<T>::DFSFrom(VertexNode<T> *startNode)
 {
-    // TODO: Add a new entity to the Knowledge Graph
-    if (this->graph.contains(entity))
-        throw EntityExistsException();
-
-    this->graph.add(entity);
-    this->entities.push_back(entity);
+    this->dfsIds(startNode, this->orderScratch);
+    return this->formatIds(this->orderScratch);
 }
 
-void KnowledgeGraph::addRelation(string from, string to, float weight)
+// out doubles as the BFS queue
+template <class T>
+void DGraphModel<T>::bfsIds(VertexNode<T> *startNode, vector<int> &out)
 {
-    // TODO: Add a directed relation
-    if (!this->graph.contains(from) || !this->graph.contains(to))
-        throw EntityNotFoundException();
+    out.clear();
+    this->visited.reset(this->idBound());
+    this->visited.mark(startNode->id);
+    out.push_back(startNode->id);
 
-    this->graph.connect(from, to, weight);
+    for (size_t idx = 0; idx < out.size(); ++idx)
+    {
+        for (Edge<T> *edge : this->nodeList[out[idx]]->outEdges())
+        {
+            int v = edge->getTo()->id;
+            if (this->visited.mark(v))
+                out.push_back(v);
+        }
+    }
 }
 
-// TODO: Implement other methods of KnowledgeGraph:
-
-vector<string> KnowledgeGraph::getAllEntities()
+template <class T>
+void DGraphModel<T>::dfsIds(VertexNode<T> *startNode, vector<int> &out)
 {
-    return this->entities;
+    out.clear();
+    this->walker.start(startNode, this->idBound());
+    while (VertexNode<T> *u = this->walker.next())
+        out.push_back(u->id);
 }
 
-vector<string> KnowledgeGraph::getNeighbors(string entity)
+// Level by level: hop h expands exactly the vertices taken at hop h - 1,
+// which sit in out[levelBegin, levelEnd)
+template <class T>
+void DGraphModel<T>::kHopIds(VertexNode<T> *startNode, const KHopOptions &options,
+                             vector<int> &out, vector<double> *distances)
 {
-    if (!this->graph.contains(entity))
-        throw EntityNotFoundException();
-
-    vector<Edge<string> *> edges = this->graph.getOutwardEdges(entity);
-    vector<string> neighbors;
-
-    for (Edge<string> *edge : edges)
+    out.clear();
+    if (distances != nullptr)
+        distances->clear();
+    if (options.maxDistance >= 0)
     {
-        neighbors.push_back(edge->getTo()->getVertex());
+        this->weightedKHopIds(startNode, options, out, distances);
+        return;
     }
 
-    return neighbors;
-}
+    size_t limit = options.maxResults > 0 ? options.maxResults : SIZE_MAX;
+    this->visited.reset(this->idBound());
+    this->visited.mark(startNode->id);
 
-string KnowledgeGraph::bfs(string start)
-{
-    if (!this->graph.contains(start))
-        throw EntityNotFoundException();
+    size_t levelBegin = 0, levelEnd = 0;
+    for (int hop = 1; hop <= options.maxHops && out.size() < limit; ++hop)
+    {
+        size_t cap = options.perHopLimit > 0 ? min(limit, out.size() + options.perHopLimit) : limit;
 
-    return this->graph.BFS(start);
-}
+        // false once this hop is full, the rest of the level is skipped
+        auto expand = [&](VertexNode<T> *u) -> bool
+        {
+            for (Edge<T> *edge : u->outEdges())
+            {
+                int v = edge->to->id;
+                if (!this->visited.mark(v))
+                    continue;
+                out.push_back(v);
+                if (out.size() >= cap)
+                    return false;
+            }
+            return true;
+        };
 
-string KnowledgeGraph::dfs(string start)
-{
-    if (!this->graph.contains(start))
-        throw EntityNotFoundException();
+        if (hop == 1)
+            expand(startNode);
+        for (size_t i = levelBegin; i < levelEnd && expand(this->nodeList[out[i]]); ++i)
+        {
+        }
 
-    return this->graph.DFS(start);
+        if (distances != nullptr)
+            distances->resize(out.size(), hop);
+        levelBegin = levelEnd;
+        levelEnd = out.size();
+        if (levelBegin == levelEnd)
+            break;
+    }
 }
 
-bool KnowledgeGraph::isReachable(string from, string to)
+// Hop-bounded Bellman-Ford: round h relaxes the out-edges of the vertices
+// whose distance improved in round h - 1, using that round's distances, so
+// pathDist[v] is the cheapest path of at most h edges. Paths over the
+// budget are dropped as soon as they exceed it.
+template <class T>
+void DGraphModel<T>::weightedKHopIds(VertexNode<T> *startNode, const KHopOptions &options,
+                                     vector<int> &out, vector<double> *distances)
 {
-    if (!this->graph.contains(from) || !this->graph.contains(to))
-        throw EntityNotFoundException();
-
-    vector<string> visited;
-    vector<string> q;
-    int idx = 0;
+    int n = this->idBound();
+    size_t limit = options.maxResults > 0 ? options.maxResults : SIZE_MAX;
+    this->visited.reset(n);
+    this->pathReached.reset(n);
+    if ((int)this->pathDist.size() < n)
+    {
+        this->pathDist.resize(n);
+        this->pathEstimate.resize(n);
+        this->pathParent.resize(n);
+    }
 
-    visited.push_back(from);
-    q.push_back(from);
+    vector<pair<int, double>> frontier(1, make_pair(startNode->id, 0.0));
+    vector<int> next;
+    this->visited.mark(startNode->id);
+    this->pathReached.mark(startNode->id);
+    this->pathDist[startNode->id] = 0;
 
-    while (idx < (int)q.size())
+    for (int hop = 1; hop <= options.maxHops && !frontier.empty(); ++hop)
     {
-        string current = q[idx++];
-
-        if (current == to)
-            return true;
+        size_t cap = options.perHopLimit > 0 ? min(limit, out.size() + options.perHopLimit) : limit;
+        this->roundQueued.reset(n);
+        next.clear();
 
-        vector<Edge<string> *> edges = this->graph.getOutwardEdges(current);
-        for (Edge<string> *edge : edges)
+        for (const pair<int, double> &entry : frontier)
         {
-            string neighbor = edge->getTo()->getVertex();
-
-            bool seen = false;
-            for (string &v : visited)
+            for (Edge<T> *edge : this->nodeList[entry.first]->outEdges())
             {
-                if (v == neighbor)
+                if (edge->weight < 0)
+                    throw NegativeWeightException();
+
+                double dist = entry.second + edge->weight;
+                int v = edge->to->id;
+                if (dist > options.maxDistance)
+                    continue;
+                if (this->pathReached.test(v) && dist >= this->pathDist[v])
+                    continue;
+
+                if (!this->visited.test(v))
                 {
-                    seen = true;
-                    break;
+                    if (out.size() >= cap)
+                        continue;
+                    this->visited.mark(v);
+                    out.push_back(v);
                 }
-            }
-
-            if (!seen)
-            {
-                visited.push_back(neighbor);
-                q.push_back(neighbor);
+                this->pathReached.mark(v);
+                this->pathDist[v] = dist;
+                if (this->roundQueued.mark(v))
+                    next.push_back(v);
             }
         }
+
+        frontier.clear();
+        for (int v : next)
+            frontier.push_back(make_pair(v, this->pathDist[v]));
     }
 
-    return false;
+    if (distances != nullptr)
+    {
+        distances->reserve(out.size());
+        for (int v : out)
+            distances->push_back(this->pathDist[v]);
+    }
 }
 
-string KnowledgeGraph::toString()
+template <class T>
+void DGraphModel<T>::visitBFS(VertexNode<T> *startNode, const Visitor &visit)
 {
-    return this->graph.toString();
-}
+    vector<VertexNode<T> *> q;
 
-vector<string> KnowledgeGraph::getRelatedEntities(string entity, int depth)
-{
-    if (!this->graph.contains(entity))
-        throw EntityNotFoundException();
+    this->visited.reset(this->idBound());
+    this->visited.mark(startNode->id);
+    q.push_back(startNode);
 
-    if (depth <= 0)
-        return vector<string>();
+    for (size_t idx = 0; idx < q.size(); ++idx)
+    {
+        VertexNode<T> *u = q[idx];
+        if (!visit(u))
+            return;
+
+        for (Edge<T> *edge : u->outEdges())
+        {
+            VertexNode<T> *v = edge->getTo();
+            if (this->visited.mark(v->id))
+                q.push_back(v);
+        }
+    }
+}
+
+template <class T>
+void DGraphModel<T>::visitDFS(VertexNode<T> *startNode, const Visitor &visit)
+{
+    this->walker.start(startNode, this->idBound());
+    while (VertexNode<T> *u = this->walker.next())
+        if (!visit(u))
+            return;
+}
+
+template <class T>
+string DGraphModel<T>::formatIds(const vector<int> &ids)
+{
+    stringstream ss;
+    ss << "[";
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i > 0)
+            ss << ", ";
+        ss << this->vertex2Str(*this->nodeList[ids[i]]);
+    }
+    ss << "]";
+    return ss.str();
+}
+
+template <class T>
+CSRGraph<T> DGraphModel<T>::freeze()
+{
+    CSRGraph<T> csr(this->vertexEQ, this->vertex2str, this->vertexHash);
+    int n = this->liveCount;
+
+    // Dense ids follow nodeList order, removed vertices are squeezed out
+    vector<VertexNode<T> *> live;
+    vector<int> csrId(this->nodeList.size(), -1);
+    live.reserve(n);
+    for (VertexNode<T> *node : this->nodeList)
+    {
+        if (node == nullptr)
+            continue;
+        csrId[node->id] = live.size();
+        live.push_back(node);
+    }
+
+    csr.vertexList.reserve(n);
+    for (int i = 0; i < n; ++i)
+    {
+        csr.vertexList.push_back(live[i]->vertex);
+        if (csr.isIndexed())
+            csr.vertexIndex.emplace(csr.hashOf(csr.vertexList[i]), i);
+    }
+
+    // Outgoing rows, edges kept in adjacency order
+    csr.outOffsets.assign(n + 1, 0);
+    csr.inOffsets.assign(n + 1, 0);
+    for (int i = 0; i < n; ++i)
+    {
+        for (Edge<T> *edge : live[i]->outEdges())
+        {
+            int target = csrId[edge->to->id];
+            csr.outTargets.push_back(target);
+            csr.outWeights.push_back(edge->weight);
+            csr.inOffsets[target + 1]++;
+        }
+        csr.outOffsets[i + 1] = csr.outTargets.size();
+    }
+
+    // Incoming rows by counting sort; sources come out in ascending id order
+    for (int i = 0; i < n; ++i)
+        csr.inOffsets[i + 1] += csr.inOffsets[i];
+
+    csr.inSources.resize(csr.outTargets.size());
+    vector<int> fill(csr.inOffsets.begin(), csr.inOffsets.end() - 1);
+    for (int u = 0; u < n; ++u)
+    {
+        for (int e = csr.outOffsets[u]; e < csr.outOffsets[u + 1]; ++e)
+            csr.inSources[fill[csr.outTargets[e]]++] = u;
+    }
+
+    return csr;
+}
+
+template <class T>
+vector<VertexNode<T> *> DGraphModel<T>::parallelBFSOrder(VertexNode<T> *startNode,
+                                                         const ParallelBFSOptions &options,
+                                                         VertexNode<T> *stopAt)
+{
+    if (options.alpha <= 0 || options.beta <= 0)
+        throw invalid_argument("ParallelBFSOptions: alpha and beta must be positive");
+
+    int n = this->idBound();
+    int threads = options.threads > 0 ? options.threads : max(1u, thread::hardware_concurrency());
+
+    // A vertex joins the level of whichever thread flips its bit first
+    size_t words = (n + 63) / 64;
+    unique_ptr<atomic<unsigned long long>[]> seen(new atomic<unsigned long long>[words]);
+    for (size_t w = 0; w < words; ++w)
+        seen[w].store(0, memory_order_relaxed);
+
+    auto isSeen = [&](int id) -> bool
+    {
+        return (seen[id >> 6].load(memory_order_relaxed) >> (id & 63)) & 1;
+    };
+    auto claim = [&](int id) -> bool
+    {
+        unsigned long long bit = 1ULL << (id & 63);
+        if (seen[id >> 6].load(memory_order_relaxed) & bit)
+            return false;
+        return !(seen[id >> 6].fetch_or(bit, memory_order_relaxed) & bit);
+    };
+
+    long long unexplored = 0;
+    for (VertexNode<T> *node : this->nodeList)
+        if (node != nullptr)
+            unexplored += node->outDegree_;
+
+    vector<VertexNode<T> *> order;
+    vector<VertexNode<T> *> frontier, next;
+    vector<vector<VertexNode<T> *>> found(threads);
+    vector<unsigned long long> frontierBits;
+
+    // Deterministic mode: per-vertex (frontier position, edge index) of its
+    // first discovery, the key that orders a level in sequential BFS
+    vector<int> levelOf;
+    unique_ptr<atomic<unsigned long long>[]> firstSeen;
+    if (options.deterministic)
+    {
+        levelOf.assign(n, -1);
+        firstSeen.reset(new atomic<unsigned long long>[n]);
+        for (int i = 0; i < n; ++i)
+            firstSeen[i].store(ULLONG_MAX, memory_order_relaxed);
+        levelOf[startNode->id] = 0;
+    }
+
+    claim(startNode->id);
+    order.push_back(startNode);
+    frontier.push_back(startNode);
+    bool bottomUp = false;
+
+    for (int level = 0; !frontier.empty(); ++level)
+    {
+        if (stopAt != nullptr && isSeen(stopAt->id))
+            break;
+
+        long long frontierEdges = 0;
+        for (VertexNode<T> *u : frontier)
+            frontierEdges += u->outDegree_;
+
+        if (!bottomUp && frontierEdges > unexplored / options.alpha)
+            bottomUp = true;
+        else if (bottomUp && (long long)frontier.size() < n / options.beta)
+            bottomUp = false;
+        unexplored -= frontierEdges;
+
+        for (vector<VertexNode<T> *> &list : found)
+            list.clear();
+
+        if (!bottomUp)
+        {
+            int workers = (int)frontier.size() < options.minParallelWork ? 1 : threads;
+            this->workerPool.run(workers, frontier.size(), [&](size_t begin, size_t end, int worker)
+                        {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    for (Edge<T> *edge : frontier[i]->outEdges())
+                    {
+                        VertexNode<T> *v = edge->to;
+                        if (claim(v->id))
+                        {
+                            if (options.deterministic)
+                                levelOf[v->id] = level + 1;
+                            found[worker].push_back(v);
+                        }
+                    }
+                } });
+        }
+        else
+        {
+            frontierBits.assign(words, 0);
+            for (VertexNode<T> *u : frontier)
+                frontierBits[u->id >> 6] |= 1ULL << (u->id & 63);
+
+            int workers = n < options.minParallelWork ? 1 : threads;
+            this->workerPool.run(workers, n, [&](size_t begin, size_t end, int worker)
+                        {
+                for (size_t id = begin; id < end; ++id)
+                {
+                    VertexNode<T> *v = this->nodeList[id];
+                    if (v == nullptr || isSeen(id))
+                        continue;
+
+                    for (Edge<T> *edge : v->inEdges())
+                    {
+                        int p = edge->from->id;
+                        if ((frontierBits[p >> 6] >> (p & 63)) & 1)
+                        {
+                            claim(id);
+                            if (options.deterministic)
+                                levelOf[id] = level + 1;
+                            found[worker].push_back(v);
+                            break;
+                        }
+                    }
+                } });
+        }
+
+        next.clear();
+        for (vector<VertexNode<T> *> &list : found)
+            next.insert(next.end(), list.begin(), list.end());
+
+        if (options.deterministic && !next.empty())
+        {
+            int workers = (int)frontier.size() < options.minParallelWork ? 1 : threads;
+            this->workerPool.run(workers, frontier.size(), [&](size_t begin, size_t end, int)
+                        {
+                for (size_t pos = begin; pos < end; ++pos)
+                {
+                    unsigned k = 0;
+                    for (Edge<T> *edge : frontier[pos]->outEdges())
+                    {
+                        int v = edge->to->id;
+                        if (levelOf[v] != level + 1)
+                        {
+                            ++k;
+                            continue;
+                        }
+
+                        unsigned long long key = ((unsigned long long)pos << 32) | (unsigned)k;
+                        unsigned long long current = firstSeen[v].load(memory_order_relaxed);
+                        while (key < current && !firstSeen[v].compare_exchange_weak(current, key, memory_order_relaxed))
+                        {
+                        }
+                        ++k;
+                    }
+                } });
+
+            sort(next.begin(), next.end(), [&](VertexNode<T> *a, VertexNode<T> *b)
+                 { return firstSeen[a->id].load(memory_order_relaxed) < firstSeen[b->id].load(memory_order_relaxed); });
+        }
+
+        order.insert(order.end(), next.begin(), next.end());
+        frontier.swap(next);
+    }
+
+    return order;
+}
+
+template <class T>
+string DGraphModel<T>::parallelBFS(T start, const ParallelBFSOptions &options)
+{
+    if (this->liveCount == 0)
+        return "[]";
+
+    VertexNode<T> *startNode = this->getVertexNode(start);
+    if (startNode == nullptr)
+        throw VertexNotFoundException();
+
+    vector<VertexNode<T> *> order = this->parallelBFSOrder(startNode, options);
+
+    stringstream ss;
+    ss << "[";
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        if (i > 0)
+            ss << ", ";
+        ss << this->vertex2Str(*order[i]);
+    }
+    ss << "]";
+    return ss.str();
+}
+
+template <class T>
+bool DGraphModel<T>::parallelReachable(T from, T to, const ParallelBFSOptions &options)
+{
+    VertexNode<T> *fromNode = this->getVertexNode(from);
+    VertexNode<T> *toNode = this->getVertexNode(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw VertexNotFoundException();
+
+    // The search stops after the level containing toNode, so look from the back
+    vector<VertexNode<T> *> order = this->parallelBFSOrder(fromNode, options, toNode);
+    return find(order.rbegin(), order.rend(), toNode) != order.rend();
+}
+
+// Dijkstra when heuristic is null, A* otherwise. Keys are dist + estimate;
+// a vertex whose distance improves after it was popped (possible with an
+// inconsistent heuristic) is queued again, so the first pop of the target
+// is optimal as long as the heuristic never overestimates.
+template <class T>
+PathResult DGraphModel<T>::searchPath(const vector<VertexNode<T> *> &sources,
+                                      VertexNode<T> *target,
+                                      const PathHeuristic *heuristic)
+{
+    int n = this->idBound();
+    this->pathReached.reset(n);
+    this->pathHeap.reset(n);
+    if ((int)this->pathDist.size() < n)
+    {
+        this->pathDist.resize(n);
+        this->pathEstimate.resize(n);
+        this->pathParent.resize(n);
+    }
+
+    auto reach = [&](VertexNode<T> *v, int parent, double dist)
+    {
+        int id = v->id;
+        if (this->pathReached.mark(id))
+            this->pathEstimate[id] = heuristic != nullptr ? (*heuristic)(v, target) : 0;
+        else if (dist >= this->pathDist[id])
+            return;
+
+        this->pathDist[id] = dist;
+        this->pathParent[id] = parent;
+        this->pathHeap.pushOrDecrease(id, dist + this->pathEstimate[id]);
+    };
+
+    for (VertexNode<T> *source : sources)
+        reach(source, -1, 0);
+
+    PathResult result;
+    while (!this->pathHeap.empty())
+    {
+        int u = this->pathHeap.pop();
+        if (u == target->id)
+        {
+            result.found = true;
+            result.cost = this->pathDist[u];
+            for (int v = u; v >= 0; v = this->pathParent[v])
+                result.path.push_back(v);
+            reverse(result.path.begin(), result.path.end());
+            break;
+        }
+
+        for (Edge<T> *edge : this->nodeList[u]->outEdges())
+        {
+            if (edge->weight < 0)
+                throw NegativeWeightException();
+            reach(edge->to, u, this->pathDist[u] + edge->weight);
+        }
+    }
+    return result;
+}
+
+template <class T>
+PathResult DGraphModel<T>::shortestPath(T from, T to)
+{
+    VertexNode<T> *fromNode = this->getVertexNode(from);
+    VertexNode<T> *toNode = this->getVertexNode(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw VertexNotFoundException();
+
+    return this->searchPath(vector<VertexNode<T> *>(1, fromNode), toNode);
+}
+
+template <class T>
+PathResult DGraphModel<T>::shortestPathAStar(T from, T to, const PathHeuristic &heuristic)
+{
+    VertexNode<T> *fromNode = this->getVertexNode(from);
+    VertexNode<T> *toNode = this->getVertexNode(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw VertexNotFoundException();
+
+    return this->searchPath(vector<VertexNode<T> *>(1, fromNode), toNode, &heuristic);
+}
+
+template <class T>
+PathResult DGraphModel<T>::shortestPathFromAny(const vector<T> &sources, T to)
+{
+    VertexNode<T> *toNode = this->getVertexNode(to);
+    if (toNode == nullptr)
+        throw VertexNotFoundException();
+
+    vector<VertexNode<T> *> sourceNodes;
+    sourceNodes.reserve(sources.size());
+    for (T source : sources)
+    {
+        VertexNode<T> *node = this->getVertexNode(source);
+        if (node == nullptr)
+            throw VertexNotFoundException();
+        sourceNodes.push_back(node);
+    }
+
+    return this->searchPath(sourceNodes, toNode);
+}
+
+// =============================================================================
+// Class CSRView Implementation
+// =============================================================================
+
+CSRView::CSRView()
+{
+    this->numVertices = 0;
+    this->numEdges = 0;
+    this->outOffsets = nullptr;
+    this->outTargets = nullptr;
+    this->outWeights = nullptr;
+    this->inOffsets = nullptr;
+    this->inSources = nullptr;
+}
+
+vector<int> CSRView::bfsOrder(int start) const
+{
+    vector<int> order;
+    vector<char> visited(this->numVertices, 0);
+
+    visited[start] = 1;
+    order.push_back(start);
+
+    for (size_t idx = 0; idx < order.size(); ++idx)
+    {
+        int u = order[idx];
+        for (int e = this->outOffsets[u]; e < this->outOffsets[u + 1]; ++e)
+        {
+            int v = this->outTargets[e];
+            if (!visited[v])
+            {
+                visited[v] = 1;
+                order.push_back(v);
+            }
+        }
+    }
+    return order;
+}
+
+vector<int> CSRView::dfsOrder(int start) const
+{
+    vector<int> order;
+    vector<char> visited(this->numVertices, 0);
+
+    // Each frame is (vertex, next edge to try), same order as a recursive DFS
+    vector<pair<int, int>> stack;
+
+    visited[start] = 1;
+    order.push_back(start);
+    stack.push_back(make_pair(start, this->outOffsets[start]));
+
+    while (!stack.empty())
+    {
+        pair<int, int> &top = stack.back();
+        if (top.second == this->outOffsets[top.first + 1])
+        {
+            stack.pop_back();
+            continue;
+        }
+
+        int v = this->outTargets[top.second++];
+        if (!visited[v])
+        {
+            visited[v] = 1;
+            order.push_back(v);
+            stack.push_back(make_pair(v, this->outOffsets[v]));
+        }
+    }
+    return order;
+}
+
+bool CSRView::isReachable(int from, int to) const
+{
+    if (from == to)
+        return true;
+
+    vector<char> visited(this->numVertices, 0);
+    vector<int> q;
+
+    visited[from] = 1;
+    q.push_back(from);
+
+    for (size_t idx = 0; idx < q.size(); ++idx)
+    {
+        int u = q[idx];
+        for (int e = this->outOffsets[u]; e < this->outOffsets[u + 1]; ++e)
+        {
+            int v = this->outTargets[e];
+            if (v == to)
+                return true;
+            if (!visited[v])
+            {
+                visited[v] = 1;
+                q.push_back(v);
+            }
+        }
+    }
+    return false;
+}
+
+vector<int> CSRView::related(int start, int depth) const
+{
+    vector<int> result;
+    if (depth <= 0)
+        return result;
+
+    vector<char> visited(this->numVertices, 0);
+    vector<int> frontier, next;
+
+    visited[start] = 1;
+    frontier.push_back(start);
+
+    for (int level = 0; level < depth && !frontier.empty(); ++level)
+    {
+        next.clear();
+        for (int u : frontier)
+        {
+            for (int e = this->outOffsets[u]; e < this->outOffsets[u + 1]; ++e)
+            {
+                int v = this->outTargets[e];
+                if (!visited[v])
+                {
+                    visited[v] = 1;
+                    result.push_back(v);
+                    next.push_back(v);
+                }
+            }
+        }
+        frontier.swap(next);
+    }
+    return result;
+}
+
+void CSRView::reverseDistances(int start, vector<int> &order, vector<int> &dist) const
+{
+    order.clear();
+    dist.assign(this->numVertices, -1);
+
+    dist[start] = 0;
+    order.push_back(start);
+
+    for (size_t idx = 0; idx < order.size(); ++idx)
+    {
+        int u = order[idx];
+        for (int e = this->inOffsets[u]; e < this->inOffsets[u + 1]; ++e)
+        {
+            int p = this->inSources[e];
+            if (dist[p] < 0)
+            {
+                dist[p] = dist[u] + 1;
+                order.push_back(p);
+            }
+        }
+    }
+}
+
+int CSRView::commonAncestor(int a, int b) const
+{
+    vector<int> orderA, orderB;
+    vector<int> distA, distB;
+
+    reverseDistances(a, orderA, distA);
+    reverseDistances(b, orderB, distB);
+
+    // First ancestor of a (in reverse BFS order) with the smallest total distance
+    int best = -1;
+    int bestSum = 0;
+    for (int x : orderA)
+    {
+        if (distB[x] < 0)
+            continue;
+
+        int sum = distA[x] + distB[x];
+        if (best < 0 || sum < bestSum)
+        {
+            best = x;
+            bestSum = sum;
+        }
+    }
+    return best;
+}
+
+// =============================================================================
+// Class CSRGraph Implementation
+// =============================================================================
+
+template <class T>
+CSRGraph<T>::CSRGraph(bool (*vertexEQ)(T &, T &), string (*vertex2str)(T &), size_t (*vertexHash)(T &))
+{
+    this->vertexEQ = vertexEQ;
+    this->vertex2str = vertex2str;
+    this->vertexHash = vertexHash;
+    this->outOffsets.assign(1, 0);
+    this->inOffsets.assign(1, 0);
+}
+
+template <class T>
+bool CSRGraph<T>::isIndexed()
+{
+    return (this->vertexEQ == nullptr || this->vertexHash != nullptr);
+}
+
+template <class T>
+size_t CSRGraph<T>::hashOf(T &vertex)
+{
+    if (this->vertexHash != nullptr)
+        return this->vertexHash(vertex);
+
+    return std::hash<T>()(vertex);
+}
+
+template <class T>
+bool CSRGraph<T>::matches(int id, T &vertex)
+{
+    if (this->vertexEQ != nullptr)
+        return this->vertexEQ(this->vertexList[id], vertex);
+
+    return this->vertexList[id] == vertex;
+}
+
+template <class T>
+CSRView CSRGraph<T>::view() const
+{
+    CSRView v;
+    v.numVertices = this->vertexList.size();
+    v.numEdges = this->outTargets.size();
+    v.outOffsets = this->outOffsets.data();
+    v.outTargets = this->outTargets.data();
+    v.outWeights = this->outWeights.data();
+    v.inOffsets = this->inOffsets.data();
+    v.inSources = this->inSources.data();
+    return v;
+}
+
+template <class T>
+int CSRGraph<T>::size()
+{
+    return this->vertexList.size();
+}
+
+template <class T>
+int CSRGraph<T>::indexOf(T &vertex)
+{
+    if (this->isIndexed())
+    {
+        auto range = this->vertexIndex.equal_range(this->hashOf(vertex));
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (this->matches(it->second, vertex))
+                return it->second;
+        }
+        return -1;
+    }
+
+    for (int i = 0; i < (int)this->vertexList.size(); ++i)
+    {
+        if (this->matches(i, vertex))
+            return i;
+    }
+    return -1;
+}
+
+template <class T>
+T &CSRGraph<T>::vertexAt(int id)
+{
+    return this->vertexList[id];
+}
+
+template <class T>
+string CSRGraph<T>::vertex2Str(int id)
+{
+    if (this->vertex2str != nullptr)
+        return this->vertex2str(this->vertexList[id]);
+
+    stringstream ss;
+    ss << this->vertexList[id];
+    return ss.str();
+}
+
+template <class T>
+string CSRGraph<T>::formatIds(const vector<int> &ids)
+{
+    stringstream ss;
+    ss << "[";
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i > 0)
+            ss << ", ";
+        ss << this->vertex2Str(ids[i]);
+    }
+    ss << "]";
+    return ss.str();
+}
+
+template <class T>
+string CSRGraph<T>::BFS(T start)
+{
+    if (this->vertexList.size() == 0)
+        return "[]";
+
+    int id = this->indexOf(start);
+    if (id < 0)
+        throw VertexNotFoundException();
+
+    return this->formatIds(this->view().bfsOrder(id));
+}
+
+template <class T>
+string CSRGraph<T>::DFS(T start)
+{
+    if (this->vertexList.size() == 0)
+        return "[]";
+
+    int id = this->indexOf(start);
+    if (id < 0)
+        throw VertexNotFoundException();
+
+    return this->formatIds(this->view().dfsOrder(id));
+}
+
+template <class T>
+bool CSRGraph<T>::isReachable(T from, T to)
+{
+    int fromId = this->indexOf(from);
+    int toId = this->indexOf(to);
+    if (fromId < 0 || toId < 0)
+        throw VertexNotFoundException();
+
+    return this->view().isReachable(fromId, toId);
+}
+
+template <class T>
+vector<T> CSRGraph<T>::getRelatedEntities(T start, int depth)
+{
+    int id = this->indexOf(start);
+    if (id < 0)
+        throw VertexNotFoundException();
+
+    vector<T> result;
+    for (int v : this->view().related(id, depth))
+        result.push_back(this->vertexList[v]);
+    return result;
+}
+
+template <class T>
+string CSRGraph<T>::findCommonAncestors(T vertex1, T vertex2)
+{
+    int a = this->indexOf(vertex1);
+    int b = this->indexOf(vertex2);
+    if (a < 0 || b < 0)
+        throw VertexNotFoundException();
+
+    int best = this->view().commonAncestor(a, b);
+    if (best < 0)
+        return "No common ancestor";
+    return this->vertex2Str(best);
+}
+
+// =============================================================================
+// Class ReachabilityIndex Implementation
+// =============================================================================
+
+ReachabilityIndex::ReachabilityIndex() : numVertices(0), numComponents(0) {}
+
+void ReachabilityIndex::clear()
+{
+    this->numVertices = 0;
+    this->numComponents = 0;
+    this->component.clear();
+    this->outOffsets.clear();
+    this->outHubs.clear();
+    this->inOffsets.clear();
+    this->inHubs.clear();
+}
+
+// Sorted-list intersection; hub ranks were appended in increasing order
+static bool intersects(const int *a, const int *aEnd, const int *b, const int *bEnd)
+{
+    while (a != aEnd && b != bEnd)
+    {
+        if (*a == *b)
+            return true;
+        if (*a < *b)
+            ++a;
+        else
+            ++b;
+    }
+    return false;
+}
+
+void ReachabilityIndex::build(const CSRView &graph)
+{
+    this->clear();
+    int n = graph.numVertices;
+    this->numVertices = n;
+    this->component.assign(n, -1);
+
+    // Iterative Tarjan; components are numbered as they close, sinks first
+    vector<int> index(n, -1), low(n, 0), members;
+    vector<char> onStack(n, 0);
+    vector<pair<int, int>> frames;
+    int counter = 0;
+
+    for (int root = 0; root < n; ++root)
+    {
+        if (index[root] >= 0)
+            continue;
+
+        index[root] = low[root] = counter++;
+        members.push_back(root);
+        onStack[root] = 1;
+        frames.push_back(make_pair(root, graph.outOffsets[root]));
+
+        while (!frames.empty())
+        {
+            int v = frames.back().first;
+            if (frames.back().second < graph.outOffsets[v + 1])
+            {
+                int w = graph.outTargets[frames.back().second++];
+                if (index[w] < 0)
+                {
+                    index[w] = low[w] = counter++;
+                    members.push_back(w);
+                    onStack[w] = 1;
+                    frames.push_back(make_pair(w, graph.outOffsets[w]));
+                }
+                else if (onStack[w])
+                    low[v] = min(low[v], index[w]);
+                continue;
+            }
+
+            frames.pop_back();
+            if (!frames.empty())
+            {
+                int parent = frames.back().first;
+                low[parent] = min(low[parent], low[v]);
+            }
+
+            if (low[v] == index[v])
+            {
+                int w;
+                do
+                {
+                    w = members.back();
+                    members.pop_back();
+                    onStack[w] = 0;
+                    this->component[w] = this->numComponents;
+                } while (w != v);
+                this->numComponents++;
+            }
+        }
+    }
+
+    // Condensation DAG in both directions, parallel edges merged
+    int c = this->numComponents;
+    vector<int> byComponent(n), start(c + 1, 0);
+    for (int v = 0; v < n; ++v)
+        start[this->component[v] + 1]++;
+    for (int i = 0; i < c; ++i)
+        start[i + 1] += start[i];
+    {
+        vector<int> fill(start.begin(), start.end() - 1);
+        for (int v = 0; v < n; ++v)
+            byComponent[fill[this->component[v]]++] = v;
+    }
+
+    vector<int> dagOutOffsets(c + 1, 0), dagOut, dagInOffsets(c + 1, 0), dagIn;
+    vector<int> seenBy(c, -1);
+    for (int from = 0; from < c; ++from)
+    {
+        for (int i = start[from]; i < start[from + 1]; ++i)
+        {
+            int v = byComponent[i];
+            for (int e = graph.outOffsets[v]; e < graph.outOffsets[v + 1]; ++e)
+            {
+                int to = this->component[graph.outTargets[e]];
+                if (to != from && seenBy[to] != from)
+                {
+                    seenBy[to] = from;
+                    dagOut.push_back(to);
+                    dagInOffsets[to + 1]++;
+                }
+            }
+        }
+        dagOutOffsets[from + 1] = dagOut.size();
+    }
+    for (int i = 0; i < c; ++i)
+        dagInOffsets[i + 1] += dagInOffsets[i];
+    dagIn.resize(dagOut.size());
+    {
+        vector<int> fill(dagInOffsets.begin(), dagInOffsets.end() - 1);
+        for (int from = 0; from < c; ++from)
+            for (int e = dagOutOffsets[from]; e < dagOutOffsets[from + 1]; ++e)
+                dagIn[fill[dagOut[e]]++] = from;
+    }
+
+    // Hubs are processed busiest first, so early labels cover most pairs
+    vector<int> hubOrder(c);
+    for (int i = 0; i < c; ++i)
+        hubOrder[i] = i;
+    auto weight = [&](int x)
+    {
+        return (long long)(dagOutOffsets[x + 1] - dagOutOffsets[x] + 1) *
+               (dagInOffsets[x + 1] - dagInOffsets[x] + 1);
+    };
+    stable_sort(hubOrder.begin(), hubOrder.end(), [&](int a, int b)
+                { return weight(a) > weight(b); });
+
+    // Pruned 2-hop labeling: BFS from each hub in both directions, stopping
+    // wherever earlier hubs already answer the query
+    vector<vector<int>> outLabel(c), inLabel(c);
+    auto covered = [&](int from, int to)
+    {
+        return intersects(outLabel[from].data(), outLabel[from].data() + outLabel[from].size(),
+                          inLabel[to].data(), inLabel[to].data() + inLabel[to].size());
+    };
+
+    VisitMarker mark;
+    vector<int> queue;
+    for (int rank = 0; rank < c; ++rank)
+    {
+        int hub = hubOrder[rank];
+
+        mark.reset(c);
+        mark.mark(hub);
+        queue.assign(1, hub);
+        for (size_t head = 0; head < queue.size(); ++head)
+        {
+            int x = queue[head];
+            if (covered(hub, x))
+                continue;
+            inLabel[x].push_back(rank);
+            for (int e = dagOutOffsets[x]; e < dagOutOffsets[x + 1]; ++e)
+                if (mark.mark(dagOut[e]))
+                    queue.push_back(dagOut[e]);
+        }
+
+        mark.reset(c);
+        mark.mark(hub);
+        queue.assign(1, hub);
+        for (size_t head = 0; head < queue.size(); ++head)
+        {
+            int x = queue[head];
+            if (covered(x, hub))
+                continue;
+            outLabel[x].push_back(rank);
+            for (int e = dagInOffsets[x]; e < dagInOffsets[x + 1]; ++e)
+                if (mark.mark(dagIn[e]))
+                    queue.push_back(dagIn[e]);
+        }
+    }
+
+    // Flatten into offset arrays
+    this->outOffsets.assign(c + 1, 0);
+    this->inOffsets.assign(c + 1, 0);
+    for (int x = 0; x < c; ++x)
+    {
+        this->outHubs.insert(this->outHubs.end(), outLabel[x].begin(), outLabel[x].end());
+        this->inHubs.insert(this->inHubs.end(), inLabel[x].begin(), inLabel[x].end());
+        this->outOffsets[x + 1] = this->outHubs.size();
+        this->inOffsets[x + 1] = this->inHubs.size();
+    }
+}
+
+bool ReachabilityIndex::sharesHub(int fromComponent, int toComponent) const
+{
+    const int *outBase = this->outHubs.data();
+    const int *inBase = this->inHubs.data();
+    return intersects(outBase + this->outOffsets[fromComponent], outBase + this->outOffsets[fromComponent + 1],
+                      inBase + this->inOffsets[toComponent], inBase + this->inOffsets[toComponent + 1]);
+}
+
+bool ReachabilityIndex::isReachable(int from, int to) const
+{
+    int a = this->component[from];
+    int b = this->component[to];
+    if (a == b)
+        return true;
+    if (a < b)
+        return false;
+    return this->sharesHub(a, b);
+}
+
+// =============================================================================
+// Class DynamicTopology Implementation
+// =============================================================================
+
+template <class T>
+DynamicTopology<T>::DynamicTopology(DGraphModel<T> &graph)
+    : graph(&graph), nextOrder(0), componentTotal(0), selfLoops(0), edgeTotal(0), searchWork(0), stale(true), rebuildTotal(0)
+{
+    graph.addObserver(this);
+    this->refresh();
+}
+
+template <class T>
+DynamicTopology<T>::~DynamicTopology()
+{
+    this->graph->removeObserver(this);
+}
+
+template <class T>
+int DynamicTopology<T>::find(int id)
+{
+    while (this->parent[id] != id)
+    {
+        this->parent[id] = this->parent[this->parent[id]];
+        id = this->parent[id];
+    }
+    return id;
+}
+
+template <class T>
+void DynamicTopology<T>::grow(int idBound)
+{
+    if ((int)this->parent.size() >= idBound)
+        return;
+
+    this->parent.resize(idBound);
+    this->order.resize(idBound);
+    this->members.resize(idBound);
+}
+
+template <class T>
+void DynamicTopology<T>::refresh()
+{
+    if (this->stale)
+        this->rebuild();
+}
+
+template <class T>
+void DynamicTopology<T>::rebuild()
+{
+    int n = this->graph->idBound();
+    this->parent.resize(n);
+    this->order.assign(n, 0);
+    this->members.assign(n, vector<int>());
+    this->selfLoops = 0;
+    this->edgeTotal = 0;
+    this->searchWork = 0;
+
+    // Iterative Tarjan as in ReachabilityIndex::build but over in-edges, so
+    // components close sources first and unrelated ones keep id order.
+    // A component is named by the vertex that closed it.
+    struct Frame
+    {
+        int v;
+        typename EdgeRange<T>::iterator next, end;
+    };
+    vector<int> index(n, -1), low(n, 0), open, closed;
+    vector<char> onStack(n, 0);
+    vector<Frame> frames;
+    int counter = 0;
+
+    for (int root = 0; root < n; ++root)
+    {
+        VertexNode<T> *rootNode = this->graph->getVertexNodeById(root);
+        if (rootNode == nullptr || index[root] >= 0)
+            continue;
+
+        index[root] = low[root] = counter++;
+        open.push_back(root);
+        onStack[root] = 1;
+        EdgeRange<T> edges = rootNode->inEdges();
+        frames.push_back(Frame{root, edges.begin(), edges.end()});
+
+        while (!frames.empty())
+        {
+            Frame &frame = frames.back();
+            int v = frame.v;
+            if (frame.next != frame.end)
+            {
+                int w = (*frame.next)->getFrom()->getId();
+                ++frame.next;
+                this->edgeTotal++;
+                if (w == v)
+                    this->selfLoops++;
+                if (index[w] < 0)
+                {
+                    index[w] = low[w] = counter++;
+                    open.push_back(w);
+                    onStack[w] = 1;
+                    edges = this->graph->getVertexNodeById(w)->inEdges();
+                    frames.push_back(Frame{w, edges.begin(), edges.end()});
+                }
+                else if (onStack[w])
+                    low[v] = min(low[v], index[w]);
+                continue;
+            }
+
+            frames.pop_back();
+            if (!frames.empty())
+            {
+                int up = frames.back().v;
+                low[up] = min(low[up], low[v]);
+            }
+
+            if (low[v] == index[v])
+            {
+                int w;
+                do
+                {
+                    w = open.back();
+                    open.pop_back();
+                    onStack[w] = 0;
+                    this->parent[w] = v;
+                    this->members[v].push_back(w);
+                } while (w != v);
+                closed.push_back(v);
+            }
+        }
+    }
+
+    int total = closed.size();
+    for (int i = 0; i < total; ++i)
+        this->order[closed[i]] = i;
+    for (int v = 0; v < n; ++v)
+    {
+        if (this->graph->getVertexNodeById(v) == nullptr)
+            this->parent[v] = v;
+    }
+
+    this->nextOrder = total;
+    this->componentTotal = total;
+    this->stale = false;
+    this->rebuildTotal++;
+}
+
+// Folds the given component roots into the one with the most members
+template <class T>
+int DynamicTopology<T>::merge(const vector<int> &roots)
+{
+    int into = roots[0];
+    for (int root : roots)
+    {
+        if (this->members[root].size() > this->members[into].size())
+            into = root;
+    }
+
+    for (int root : roots)
+    {
+        if (root == into)
+            continue;
+        this->parent[root] = into;
+        this->members[into].insert(this->members[into].end(),
+                                   this->members[root].begin(), this->members[root].end());
+        vector<int>().swap(this->members[root]);
+    }
+
+    this->componentTotal -= roots.size() - 1;
+    return into;
+}
+
+// Pearce-Kelly for a new edge fromRoot -> toRoot that the order has
+// backwards. forwardSet is what toRoot reaches among components ordered
+// before fromRoot, backwardSet what reaches fromRoot among those after
+// toRoot. Their orders are pooled and handed out again, backwardSet first;
+// if toRoot reaches fromRoot, the components on those paths become one
+// placed between the two sets.
+template <class T>
+void DynamicTopology<T>::reorder(int fromRoot, int toRoot)
+{
+    int lower = this->order[toRoot];
+    int upper = this->order[fromRoot];
+    int n = this->graph->idBound();
+    bool cycle = false;
+
+    // Searches since the last rebuild may scan about as many edges as a
+    // rebuild would; past that, giving up is cheaper. Nothing has changed
+    // yet at that point, so it just leaves the structure stale.
+    long long budget = 1024 + n + this->edgeTotal;
+
+    this->forwardMark.reset(n);
+    this->forwardSet.clear();
+    this->stack.assign(1, toRoot);
+    this->forwardMark.mark(toRoot);
+    while (!this->stack.empty())
+    {
+        int c = this->stack.back();
+        this->stack.pop_back();
+        this->forwardSet.push_back(c);
+        for (int v : this->members[c])
+        {
+            for (Edge<T> *edge : this->graph->getVertexNodeById(v)->outEdges())
+            {
+                if (++this->searchWork > budget)
+                {
+                    this->stale = true;
+                    return;
+                }
+                int w = this->find(edge->getTo()->getId());
+                if (w == fromRoot)
+                    cycle = true;
+                else if (this->order[w] < upper && this->forwardMark.mark(w))
+                    this->stack.push_back(w);
+            }
+        }
+    }
+
+    this->backwardMark.reset(n);
+    this->backwardSet.clear();
+    this->stack.assign(1, fromRoot);
+    this->backwardMark.mark(fromRoot);
+    while (!this->stack.empty())
+    {
+        int c = this->stack.back();
+        this->stack.pop_back();
+        this->backwardSet.push_back(c);
+        for (int v : this->members[c])
+        {
+            for (Edge<T> *edge : this->graph->getVertexNodeById(v)->inEdges())
+            {
+                if (++this->searchWork > budget)
+                {
+                    this->stale = true;
+                    return;
+                }
+                int w = this->find(edge->getFrom()->getId());
+                if (this->order[w] > lower && this->backwardMark.mark(w))
+                    this->stack.push_back(w);
+            }
+        }
+    }
+
+    // Components in both sets (and the two endpoints) form the new cycle
+    // and only contribute their orders to the pool
+    this->pool.clear();
+    vector<int> cycleRoots;
+    if (cycle)
+        cycleRoots.push_back(toRoot);
+    for (int c : this->backwardSet)
+        this->pool.push_back(this->order[c]);
+
+    size_t kept = 0;
+    for (int c : this->forwardSet)
+    {
+        if (this->backwardMark.test(c))
+            cycleRoots.push_back(c);
+        else if (cycle && c == toRoot)
+            this->pool.push_back(this->order[c]);
+        else
+        {
+            this->pool.push_back(this->order[c]);
+            this->forwardSet[kept++] = c;
+        }
+    }
+    this->forwardSet.resize(kept);
+
+    if (cycle)
+    {
+        cycleRoots.push_back(fromRoot);
+        kept = 0;
+        for (int c : this->backwardSet)
+        {
+            if (c != fromRoot && !this->forwardMark.test(c))
+                this->backwardSet[kept++] = c;
+        }
+        this->backwardSet.resize(kept);
+    }
+
+    auto byOrder = [this](int a, int b)
+    { return this->order[a] < this->order[b]; };
+    sort(this->backwardSet.begin(), this->backwardSet.end(), byOrder);
+    sort(this->forwardSet.begin(), this->forwardSet.end(), byOrder);
+    sort(this->pool.begin(), this->pool.end());
+
+    // backwardSet only moves down and forwardSet only up, which keeps every
+    // edge from or to the rest of the graph pointing forward. A merged
+    // component frees slots; they are left as gaps.
+    size_t next = 0;
+    for (int c : this->backwardSet)
+        this->order[c] = this->pool[next++];
+    if (cycle)
+        this->order[this->merge(cycleRoots)] = this->pool[next];
+    next = this->pool.size() - this->forwardSet.size();
+    for (int c : this->forwardSet)
+        this->order[c] = this->pool[next++];
+}
+
+template <class T>
+void DynamicTopology<T>::vertexAdded(int id)
+{
+    if (this->stale)
+        return;
+
+    this->grow(id + 1);
+    this->parent[id] = id;
+    this->order[id] = this->nextOrder++;
+    this->members[id].assign(1, id);
+    this->componentTotal++;
+}
+
+template <class T>
+void DynamicTopology<T>::vertexRemoved(int id)
+{
+    if (this->stale)
+        return;
+
+    int root = this->find(id);
+    if (this->members[root].size() > 1)
+    {
+        this->stale = true;
+        return;
+    }
+    this->members[root].clear();
+    this->componentTotal--;
+}
+
+template <class T>
+void DynamicTopology<T>::edgeAdded(int from, int to, float /*weight*/)
+{
+    if (this->stale)
+        return;
+    this->edgeTotal++;
+    if (from == to)
+    {
+        this->selfLoops++;
+        return;
+    }
+
+    int a = this->find(from);
+    int b = this->find(to);
+    if (a != b && this->order[a] > this->order[b])
+        this->reorder(a, b);
+}
+
+template <class T>
+void DynamicTopology<T>::edgeRemoved(int from, int to)
+{
+    if (this->stale)
+        return;
+    this->edgeTotal--;
+    if (from == to)
+        this->selfLoops--;
+    else if (this->find(from) == this->find(to))
+        this->stale = true;
+}
+
+template <class T>
+void DynamicTopology<T>::graphCleared()
+{
+    this->parent.clear();
+    this->order.clear();
+    this->members.clear();
+    this->nextOrder = 0;
+    this->componentTotal = 0;
+    this->selfLoops = 0;
+    this->edgeTotal = 0;
+    this->searchWork = 0;
+    this->stale = false;
+}
+
+template <class T>
+int DynamicTopology<T>::componentOf(int id)
+{
+    this->refresh();
+    return this->find(id);
+}
+
+template <class T>
+int DynamicTopology<T>::componentCount()
+{
+    this->refresh();
+    return this->componentTotal;
+}
+
+template <class T>
+bool DynamicTopology<T>::isAcyclic()
+{
+    this->refresh();
+    return this->componentTotal == this->graph->size() && this->selfLoops == 0;
+}
+
+template <class T>
+bool DynamicTopology<T>::mayReach(int from, int to)
+{
+    this->refresh();
+    int a = this->find(from);
+    int b = this->find(to);
+    return a == b || this->order[a] < this->order[b];
+}
+
+template <class T>
+void DynamicTopology<T>::topologicalOrder(vector<int> &out)
+{
+    this->refresh();
+
+    vector<pair<int, int>> keyed;
+    keyed.reserve(this->graph->size());
+    for (int v = 0; v < this->graph->idBound(); ++v)
+    {
+        if (this->graph->getVertexNodeById(v) != nullptr)
+            keyed.push_back(make_pair(this->order[this->find(v)], v));
+    }
+    sort(keyed.begin(), keyed.end());
+
+    out.clear();
+    out.reserve(keyed.size());
+    for (const pair<int, int> &entry : keyed)
+        out.push_back(entry.second);
+}
+
+// =============================================================================
+// Class QueryCache Implementation
+// =============================================================================
+
+double QueryCacheStats::hitRate() const
+{
+    long long lookups = this->hits + this->misses;
+    if (lookups == 0)
+        return 0;
+    return (double)this->hits / lookups;
+}
+
+string QueryCacheStats::toString() const
+{
+    stringstream ss;
+    ss << this->hits << " hits, " << this->misses << " misses ("
+       << (long long)(this->hitRate() * 100) << "% hit rate), " << this->evictions << " evictions, "
+       << this->invalidations << " invalidations, " << this->entries << "/" << this->capacity << " entries";
+    return ss.str();
+}
+
+QueryCache::QueryCache() : capacity(0), generation(0) {}
+
+QueryCache::Key QueryCache::keyOf(Query query, int first, int second)
+{
+    return Key{query, first, second};
+}
+
+void QueryCache::setCapacity(size_t capacity)
+{
+    this->capacity = capacity;
+    while (this->entries.size() > capacity)
+    {
+        this->index.erase(this->entries.back().key);
+        this->entries.pop_back();
+        this->stats.evictions++;
+    }
+}
+
+void QueryCache::clear()
+{
+    this->index.clear();
+    this->entries.clear();
+}
+
+void QueryCache::sync(unsigned long long generation)
+{
+    if (generation == this->generation)
+        return;
+
+    this->generation = generation;
+    if (!this->entries.empty())
+    {
+        this->clear();
+        this->stats.invalidations++;
+    }
+}
+
+const QueryCache::Result *QueryCache::find(const Key &key)
+{
+    auto it = this->index.find(key);
+    if (it == this->index.end())
+    {
+        this->stats.misses++;
+        return nullptr;
+    }
+
+    this->stats.hits++;
+    this->entries.splice(this->entries.begin(), this->entries, it->second);
+    return &it->second->result;
+}
+
+void QueryCache::insert(const Key &key, const Result &result)
+{
+    if (this->capacity == 0)
+        return;
+
+    auto it = this->index.find(key);
+    if (it != this->index.end())
+    {
+        it->second->result = result;
+        this->entries.splice(this->entries.begin(), this->entries, it->second);
+        return;
+    }
+
+    if (this->entries.size() == this->capacity)
+    {
+        this->index.erase(this->entries.back().key);
+        this->entries.pop_back();
+        this->stats.evictions++;
+    }
+
+    this->entries.push_front(Entry{key, result});
+    this->index.emplace(key, this->entries.begin());
+}
+
+QueryCacheStats QueryCache::getStats() const
+{
+    QueryCacheStats stats = this->stats;
+    stats.entries = this->entries.size();
+    stats.capacity = this->capacity;
+    return stats;
+}
+
+// =============================================================================
+// Class KnowledgeGraph Implementation
+// =============================================================================
+
+static bool entityEQ(string &a, string &b)
+{
+    return a == b;
+}
+
+static string entity2str(string &s)
+{
+    return s;
+}
+
+static size_t entityHash(string &s)
+{
+    return std::hash<string>()(s);
+}
+
+KnowledgeGraph::KnowledgeGraph()
+    : graph(entityEQ, entity2str, entityHash),
+      reachIndexEnabled(false), reachIndexBuilt(false), reachIndexGeneration(0)
+{
+}
+
+void KnowledgeGraph::setQueryCacheCapacity(size_t entries)
+{
+    this->queryCache.setCapacity(entries);
+}
+
+QueryCacheStats KnowledgeGraph::getQueryCacheStats() const
+{
+    return this->queryCache.getStats();
+}
+
+// With the cache off the query just runs and nothing is counted. Queries
+// that throw leave the cache untouched.
+string KnowledgeGraph::cachedText(const QueryCache::Key &key, const function<string()> &compute)
+{
+    if (!this->queryCache.enabled())
+        return compute();
+
+    this->queryCache.sync(this->graph.getGeneration());
+    if (const QueryCache::Result *hit = this->queryCache.find(key))
+        return hit->text;
+
+    QueryCache::Result result;
+    result.text = compute();
+    this->queryCache.insert(key, result);
+    return result.text;
+}
+
+vector<string> KnowledgeGraph::cachedItems(const QueryCache::Key &key, const function<vector<string>()> &compute)
+{
+    if (!this->queryCache.enabled())
+        return compute();
+
+    this->queryCache.sync(this->graph.getGeneration());
+    if (const QueryCache::Result *hit = this->queryCache.find(key))
+        return hit->items;
+
+    QueryCache::Result result;
+    result.items = compute();
+    this->queryCache.insert(key, result);
+    return result.items;
+}
+
+VertexNode<string> *KnowledgeGraph::findNode(string_view entity)
+{
+    auto it = this->symbols.find(entity);
+    if (it == this->symbols.end())
+        return nullptr;
+
+    return this->graph.getVertexNodeById(it->second);
+}
+
+VertexNode<string> *KnowledgeGraph::requireNode(string_view entity)
+{
+    VertexNode<string> *node = this->findNode(entity);
+    if (node == nullptr)
+        throw EntityNotFoundException();
+
+    return node;
+}
+
+VertexNode<string> *KnowledgeGraph::requireNode(EntityId id)
+{
+    VertexNode<string> *node = this->graph.getVertexNodeById(id);
+    if (node == nullptr)
+        throw EntityNotFoundException();
+
+    return node;
+}
+
+void KnowledgeGraph::addEntity(const string &entity)
+{
+    // TODO: Add a new entity to the Knowledge Graph
+    if (this->symbols.count(entity) > 0)
+        throw EntityExistsException();
+
+    this->graph.add(entity);
+
+    // The symbol key views the copy owned by the new vertex
+    VertexNode<string> *node = this->graph.getVertexNodeById(this->graph.idBound() - 1);
+    this->symbols.emplace(string_view(node->getVertex()), node->getId());
+}
+
+void KnowledgeGraph::addRelation(const string &from, const string &to, float weight)
+{
+    // TODO: Add a directed relation
+    VertexNode<string> *fromNode = this->findNode(from);
+    VertexNode<string> *toNode = this->findNode(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw EntityNotFoundException();
+
+    fromNode->connect(toNode, weight);
+}
+
+void KnowledgeGraph::addRelation(EntityId from, EntityId to, float weight)
+{
+    VertexNode<string> *fromNode = this->graph.getVertexNodeById(from);
+    VertexNode<string> *toNode = this->graph.getVertexNodeById(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw EntityNotFoundException();
+
+    fromNode->connect(toNode, weight);
+}
+
+void KnowledgeGraph::setRelationPolicy(EdgePolicy policy)
+{
+    this->graph.setEdgePolicy(policy);
+}
+
+void KnowledgeGraph::removeRelation(const string &from, const string &to)
+{
+    VertexNode<string> *fromNode = this->findNode(from);
+    VertexNode<string> *toNode = this->findNode(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw EntityNotFoundException();
+    if (fromNode->getEdge(toNode) == nullptr)
+        throw EdgeNotFoundException();
+
+    fromNode->removeTo(toNode);
+}
+
+void KnowledgeGraph::removeEntity(const string &entity)
+{
+    VertexNode<string> *node = this->findNode(entity);
+    if (node == nullptr)
+        throw EntityNotFoundException();
+
+    // The symbol key views the node's own string, drop it first
+    this->symbols.erase(string_view(node->getVertex()));
+    if (node->getId() < (int)this->hasPosition.size())
+        this->hasPosition[node->getId()] = 0;
+    this->graph.removeNode(node);
+}
+
+// Joins up to a handful of names for a batch error message
+static string listNames(const vector<string> &names)
+{
+    const size_t shown = 10;
+    string out;
+    for (size_t i = 0; i < names.size() && i < shown; ++i)
+    {
+        if (i > 0)
+            out += ", ";
+        out += names[i];
+    }
+    if (names.size() > shown)
+        out += ", ... (" + to_string(names.size()) + " total)";
+    return out;
+}
+
+void KnowledgeGraph::addEntities(const vector<string> &names)
+{
+    // One pass: drop repeats within the batch, collect names already present
+    unordered_map<string_view, int> batch;
+    batch.reserve(names.size());
+    vector<const string *> fresh;
+    vector<string> existing;
+    fresh.reserve(names.size());
+
+    for (const string &name : names)
+    {
+        if (this->symbols.count(name) > 0)
+        {
+            if (batch.emplace(name, 0).second)
+                existing.push_back(name);
+        }
+        else if (batch.emplace(name, 1).second)
+            fresh.push_back(&name);
+    }
+
+    if (!existing.empty())
+        throw EntityExistsException("Entity already exists: " + listNames(existing));
+
+    this->graph.reserve(this->graph.idBound() + fresh.size());
+    this->symbols.reserve(this->symbols.size() + fresh.size());
+    for (const string *name : fresh)
+    {
+        this->graph.add(*name);
+        VertexNode<string> *node = this->graph.getVertexNodeById(this->graph.idBound() - 1);
+        this->symbols.emplace(string_view(node->getVertex()), node->getId());
+    }
+}
+
+void KnowledgeGraph::addRelations(const vector<Relation> &relations)
+{
+    vector<VertexNode<string> *> froms, tos;
+    vector<float> weights;
+    froms.reserve(relations.size());
+    tos.reserve(relations.size());
+    weights.reserve(relations.size());
+
+    unordered_map<string_view, int> reported;
+    vector<string> missing;
+
+    for (const Relation &relation : relations)
+    {
+        froms.push_back(this->findNode(relation.from));
+        tos.push_back(this->findNode(relation.to));
+        weights.push_back(relation.weight);
+
+        if (froms.back() == nullptr && reported.emplace(relation.from, 0).second)
+            missing.push_back(relation.from);
+        if (tos.back() == nullptr && reported.emplace(relation.to, 0).second)
+            missing.push_back(relation.to);
+    }
+
+    if (!missing.empty())
+        throw EntityNotFoundException("Entity not found: " + listNames(missing));
+
+    this->graph.connectAll(froms, tos, weights);
+}
+
+double LoadStats::triplesPerSecond() const
+{
+    if (this->seconds <= 0)
+        return 0;
+    return (this->entities + this->relations) / this->seconds;
+}
+
+string LoadStats::toString() const
+{
+    stringstream ss;
+    ss << "loaded " << this->entities << " entities and " << this->relations
+       << " relations (" << this->lines << " lines, " << this->bytes << " bytes) in "
+       << this->seconds << " s, " << (long long)this->triplesPerSecond() << " triples/sec";
+    return ss.str();
+}
+
+// Feeds every line of in to onLine(line, lineNo) without copying it out of
+// the read buffer. Lines may end in \n or \r\n; the last one may be unterminated.
+template <class F>
+static void scanLines(istream &in, LoadStats &stats, F onLine)
+{
+    vector<char> buffer(1 << 20);
+    size_t carry = 0;
+
+    while (true)
+    {
+        // A line longer than the buffer: grow it
+        if (carry == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+        in.read(buffer.data() + carry, buffer.size() - carry);
+        size_t got = in.gcount();
+        stats.bytes += got;
+        size_t end = carry + got;
+        bool eof = (got == 0);
+
+        size_t begin = 0;
+        while (true)
+        {
+            const char *nl = static_cast<const char *>(memchr(buffer.data() + begin, '\n', end - begin));
+            if (nl == nullptr)
+                break;
+
+            size_t len = nl - (buffer.data() + begin);
+            stats.lines++;
+            onLine(string_view(buffer.data() + begin, len), stats.lines);
+            begin += len + 1;
+        }
+
+        if (eof)
+        {
+            if (begin < end)
+            {
+                stats.lines++;
+                onLine(string_view(buffer.data() + begin, end - begin), stats.lines);
+            }
+            break;
+        }
+
+        carry = end - begin;
+        memmove(buffer.data(), buffer.data() + begin, carry);
+    }
+}
+
+static string_view trimLine(string_view line)
+{
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    return line;
+}
+
+static string atLine(long long lineNo)
+{
+    return " (line " + to_string(lineNo) + ")";
+}
+
+LoadStats KnowledgeGraph::loadEntities(istream &in, ostream *report)
+{
+    LoadStats stats;
+    auto started = chrono::steady_clock::now();
+
+    scanLines(in, stats, [&](string_view line, long long lineNo)
+              {
+        line = trimLine(line);
+        if (line.empty())
+            return;
+
+        if (this->symbols.count(line) > 0)
+            throw EntityExistsException("Entity already exists: " + string(line) + atLine(lineNo));
+
+        this->graph.add(string(line));
+        VertexNode<string> *node = this->graph.getVertexNodeById(this->graph.idBound() - 1);
+        this->symbols.emplace(string_view(node->getVertex()), node->getId());
+        stats.entities++; });
+
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    if (report != nullptr)
+        *report << stats.toString() << "\n";
+    return stats;
+}
+
+LoadStats KnowledgeGraph::loadRelations(istream &in, ostream *report)
+{
+    LoadStats stats;
+    auto started = chrono::steady_clock::now();
+
+    scanLines(in, stats, [&](string_view line, long long lineNo)
+              {
+        line = trimLine(line);
+        if (line.empty())
+            return;
+
+        size_t tab1 = line.find('\t');
+        if (tab1 == string_view::npos)
+            throw invalid_argument("Malformed relation, expected from<TAB>to[<TAB>weight]" + atLine(lineNo));
+
+        string_view from = line.substr(0, tab1);
+        string_view rest = line.substr(tab1 + 1);
+        size_t tab2 = rest.find('\t');
+        string_view to = rest.substr(0, tab2);
+
+        float weight = 1.0f;
+        if (tab2 != string_view::npos)
+        {
+            string_view w = rest.substr(tab2 + 1);
+            auto parsed = from_chars(w.data(), w.data() + w.size(), weight);
+            if (parsed.ec != errc() || parsed.ptr != w.data() + w.size())
+                throw invalid_argument("Malformed weight '" + string(w) + "'" + atLine(lineNo));
+        }
+
+        VertexNode<string> *fromNode = this->findNode(from);
+        VertexNode<string> *toNode = this->findNode(to);
+        if (fromNode == nullptr)
+            throw EntityNotFoundException("Entity not found: " + string(from) + atLine(lineNo));
+        if (toNode == nullptr)
+            throw EntityNotFoundException("Entity not found: " + string(to) + atLine(lineNo));
+
+        fromNode->connect(toNode, weight);
+        stats.relations++; });
+
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    if (report != nullptr)
+        *report << stats.toString() << "\n";
+    return stats;
+}
+
+LoadStats KnowledgeGraph::loadEntitiesFile(const string &path, ostream *report)
+{
+    if (path == "-")
+        return this->loadEntities(cin, report);
+
+    ifstream in(path, ios::binary);
+    if (!in)
+        throw runtime_error("Cannot open " + path);
+    return this->loadEntities(in, report);
+}
+
+LoadStats KnowledgeGraph::loadRelationsFile(const string &path, ostream *report)
+{
+    if (path == "-")
+        return this->loadRelations(cin, report);
+
+    ifstream in(path, ios::binary);
+    if (!in)
+        throw runtime_error("Cannot open " + path);
+    return this->loadRelations(in, report);
+}
+
+// TODO: Implement other methods of KnowledgeGraph:
+
+EntityId KnowledgeGraph::getEntityId(const string &entity)
+{
+    return this->requireNode(entity)->getId();
+}
+
+const string &KnowledgeGraph::getEntityName(EntityId id)
+{
+    return this->requireNode(id)->getVertex();
+}
+
+vector<string> KnowledgeGraph::getAllEntities()
+{
+    vector<string> entities;
+    entities.reserve(this->graph.size());
+
+    for (int id = 0; id < this->graph.idBound(); ++id)
+    {
+        VertexNode<string> *node = this->graph.getVertexNodeById(id);
+        if (node != nullptr)
+            entities.push_back(node->getVertex());
+    }
+
+    return entities;
+}
+
+vector<string> KnowledgeGraph::getNeighbors(const string &entity)
+{
+    VertexNode<string> *node = this->requireNode(entity);
+
+    vector<string> neighbors;
+    neighbors.reserve(node->outDegree());
+
+    for (Edge<string> *edge : node->outEdges())
+    {
+        neighbors.push_back(edge->getTo()->getVertex());
+    }
+
+    return neighbors;
+}
+
+vector<EntityId> KnowledgeGraph::getNeighbors(EntityId entity)
+{
+    VertexNode<string> *node = this->requireNode(entity);
+
+    vector<EntityId> neighbors;
+    neighbors.reserve(node->outDegree());
+
+    for (Edge<string> *edge : node->outEdges())
+    {
+        neighbors.push_back(edge->getTo()->getId());
+    }
+
+    return neighbors;
+}
+
+// Both overloads resolve the start once and share the id-keyed entry
+string KnowledgeGraph::cachedBFS(VertexNode<string> *start)
+{
+    return this->cachedText(QueryCache::keyOf(QueryCache::BFS, start->getId()), [&]()
+                            { return this->graph.BFSFrom(start); });
+}
+
+string KnowledgeGraph::bfs(const string &start)
+{
+    return this->cachedBFS(this->requireNode(start));
+}
+
+string KnowledgeGraph::bfs(EntityId start)
+{
+    return this->cachedBFS(this->requireNode(start));
+}
+
+string KnowledgeGraph::dfs(const string &start)
+{
+    return this->graph.DFSFrom(this->requireNode(start));
+}
+
+string KnowledgeGraph::dfs(EntityId start)
+{
+    return this->graph.DFSFrom(this->requireNode(start));
+}
+
+vector<EntityId> KnowledgeGraph::bfsIds(const string &start)
+{
+    vector<EntityId> ids;
+    this->graph.bfsIds(this->requireNode(start), ids);
+    return ids;
+}
+
+vector<EntityId> KnowledgeGraph::dfsIds(const string &start)
+{
+    vector<EntityId> ids;
+    this->graph.dfsIds(this->requireNode(start), ids);
+    return ids;
+}
+
+void KnowledgeGraph::bfsIds(EntityId start, vector<EntityId> &out)
+{
+    this->graph.bfsIds(this->requireNode(start), out);
+}
+
+void KnowledgeGraph::dfsIds(EntityId start, vector<EntityId> &out)
+{
+    this->graph.dfsIds(this->requireNode(start), out);
+}
+
+void KnowledgeGraph::bfsVisit(EntityId start, const function<bool(EntityId)> &visit)
+{
+    this->graph.visitBFS(this->requireNode(start), [&](VertexNode<string> *node)
+                         { return visit(node->getId()); });
+}
+
+void KnowledgeGraph::dfsVisit(EntityId start, const function<bool(EntityId)> &visit)
+{
+    this->graph.visitDFS(this->requireNode(start), [&](VertexNode<string> *node)
+                         { return visit(node->getId()); });
+}
+
+string KnowledgeGraph::formatEntities(const vector<EntityId> &ids)
+{
+    for (EntityId id : ids)
+        this->requireNode(id);
+
+    return this->graph.formatIds(ids);
+}
+
+bool KnowledgeGraph::isReachable(const string &from, const string &to)
+{
+    VertexNode<string> *fromNode = this->findNode(from);
+    VertexNode<string> *toNode = this->findNode(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw EntityNotFoundException();
+
+    return this->isReachable(fromNode, toNode);
+}
+
+bool KnowledgeGraph::isReachable(EntityId from, EntityId to)
+{
+    VertexNode<string> *fromNode = this->graph.getVertexNodeById(from);
+    VertexNode<string> *toNode = this->graph.getVertexNodeById(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw EntityNotFoundException();
+
+    return this->isReachable(fromNode, toNode);
+}
+
+// Bidirectional BFS: forward from fromNode over outgoing edges, backward
+// from toNode over incoming edges. Each round expands one full level of the
+// side with fewer edges to scan, and stops as soon as it touches a vertex
+// the other side has seen. Either frontier running dry means unreachable.
+// All state lives in the caller's scratch, so searches on different scratch
+// can run side by side.
+static bool bidirectionalReach(VertexNode<string> *fromNode, VertexNode<string> *toNode, int bound,
+                               VisitMarker &forwardSeen, VisitMarker &backwardSeen,
+                               vector<VertexNode<string> *> &forward,
+                               vector<VertexNode<string> *> &backward,
+                               vector<VertexNode<string> *> &next)
+{
+    if (fromNode == toNode)
+        return true;
+
+    forwardSeen.reset(bound);
+    backwardSeen.reset(bound);
+    forwardSeen.mark(fromNode->getId());
+    backwardSeen.mark(toNode->getId());
+    forward.assign(1, fromNode);
+    backward.assign(1, toNode);
+
+    while (!forward.empty() && !backward.empty())
+    {
+        long long forwardCost = 0, backwardCost = 0;
+        for (VertexNode<string> *node : forward)
+            forwardCost += node->outDegree();
+        for (VertexNode<string> *node : backward)
+            backwardCost += node->inDegree();
+
+        next.clear();
+        if (forwardCost <= backwardCost)
+        {
+            for (VertexNode<string> *node : forward)
+            {
+                for (Edge<string> *edge : node->outEdges())
+                {
+                    VertexNode<string> *neighbor = edge->getTo();
+                    if (backwardSeen.test(neighbor->getId()))
+                        return true;
+                    if (forwardSeen.mark(neighbor->getId()))
+                        next.push_back(neighbor);
+                }
+            }
+            forward.swap(next);
+        }
+        else
+        {
+            for (VertexNode<string> *node : backward)
+            {
+                for (Edge<string> *edge : node->inEdges())
+                {
+                    VertexNode<string> *neighbor = edge->getFrom();
+                    if (forwardSeen.test(neighbor->getId()))
+                        return true;
+                    if (backwardSeen.mark(neighbor->getId()))
+                        next.push_back(neighbor);
+                }
+            }
+            backward.swap(next);
+        }
+    }
+
+    return false;
+}
+
+void KnowledgeGraph::refreshReachabilityIndex()
+{
+    if (this->isReachabilityIndexFresh())
+        return;
+
+    CSRGraph<string> frozen = this->graph.freeze();
+    this->reachIndex.build(frozen.view());
+
+    // freeze() squeezes out removed entities, so dense ids drift
+    int dense = 0;
+    this->reachIdOf.assign(this->graph.idBound(), -1);
+    for (int id = 0; id < this->graph.idBound(); ++id)
+        if (this->graph.getVertexNodeById(id) != nullptr)
+            this->reachIdOf[id] = dense++;
+
+    this->reachIndexBuilt = true;
+    this->reachIndexGeneration = this->graph.getGeneration();
+}
+
+bool KnowledgeGraph::isReachable(VertexNode<string> *fromNode, VertexNode<string> *toNode)
+{
+    if (fromNode == toNode)
+        return true;
+
+    if (this->topology)
+    {
+        if (this->topology->componentOf(fromNode->getId()) == this->topology->componentOf(toNode->getId()))
+            return true;
+        if (!this->topology->mayReach(fromNode->getId(), toNode->getId()))
+            return false;
+    }
+
+    if (this->reachIndexEnabled)
+    {
+        this->refreshReachabilityIndex();
+        return this->reachIndex.isReachable(this->reachIdOf[fromNode->getId()],
+                                            this->reachIdOf[toNode->getId()]);
+    }
+
+    return bidirectionalReach(fromNode, toNode, this->graph.idBound(),
+                              this->visited, this->visitedBackward,
+                              this->forwardFrontier, this->backwardFrontier, this->frontierScratch);
+}
+
+void KnowledgeGraph::enableReachabilityIndex(bool enabled)
+{
+    this->reachIndexEnabled = enabled;
+    if (!enabled)
+    {
+        this->reachIndex.clear();
+        this->reachIdOf.clear();
+        this->reachIndexBuilt = false;
+    }
+}
+
+bool KnowledgeGraph::isReachabilityIndexFresh()
+{
+    return this->reachIndexBuilt && this->reachIndexGeneration == this->graph.getGeneration();
+}
+
+void KnowledgeGraph::enableTopologyTracking(bool enabled)
+{
+    if (!enabled)
+        this->topology.reset();
+    else if (!this->topology)
+        this->topology.reset(new DynamicTopology<string>(this->graph));
+}
+
+bool KnowledgeGraph::isAcyclic()
+{
+    if (this->topology)
+        return this->topology->isAcyclic();
+
+    return DynamicTopology<string>(this->graph).isAcyclic();
+}
+
+bool KnowledgeGraph::stronglyConnected(const string &entity1, const string &entity2)
+{
+    int id1 = this->requireNode(entity1)->getId();
+    int id2 = this->requireNode(entity2)->getId();
+    if (this->topology)
+        return this->topology->componentOf(id1) == this->topology->componentOf(id2);
+
+    DynamicTopology<string> once(this->graph);
+    return once.componentOf(id1) == once.componentOf(id2);
+}
+
+vector<string> KnowledgeGraph::topologicalOrder()
+{
+    vector<int> ids;
+    if (this->topology)
+        this->topology->topologicalOrder(ids);
+    else
+        DynamicTopology<string>(this->graph).topologicalOrder(ids);
+
+    vector<string> names;
+    names.reserve(ids.size());
+    for (int id : ids)
+        names.push_back(this->graph.getVertexNodeById(id)->getVertex());
+    return names;
+}
+
+string KnowledgeGraph::bfsParallel(const string &start, const ParallelBFSOptions &options)
+{
+    this->requireNode(start);
+    return this->graph.parallelBFS(start, options);
+}
+
+bool KnowledgeGraph::isReachableParallel(const string &from, const string &to, const ParallelBFSOptions &options)
+{
+    if (this->findNode(from) == nullptr || this->findNode(to) == nullptr)
+        throw EntityNotFoundException();
+
+    return this->graph.parallelReachable(from, to, options);
+}
+
+// Index of the lowest set bit; bits must not be 0
+static int lowestBit(unsigned long long bits)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#elif defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+    for (; (bits & 1) == 0; bits >>= 1)
+        index++;
+    return index;
+#endif
+}
+
+// Forward multi-source BFS over up to 64 queries, bit i standing for query
+// i. A vertex is expanded once per level for all queries sitting on it.
+// Sized to the graph's id bound and left zeroed for the next group.
+struct MultiSourceBFS
+{
+    // Kept side by side per vertex, so an edge touches one cache line
+    struct Masks
+    {
+        unsigned long long seen, visit, visitNext;
+    };
+    vector<Masks> masks;
+    vector<int> frontier, next, touched;
+
+    explicit MultiSourceBFS(int n) : masks(n, Masks{0, 0, 0}) {}
+
+    // Query i starts at sources[i] and stops after depths[i] hops. Every
+    // vertex it reaches is appended to found[i], hop by hop and in id
+    // order within a hop.
+    void run(DGraphModel<string> &graph, const int *sources, const int *depths, int count, vector<int> *found)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            int s = sources[i];
+            if (this->masks[s].seen == 0)
+            {
+                this->frontier.push_back(s);
+                this->touched.push_back(s);
+            }
+            this->masks[s].seen |= 1ULL << i;
+            this->masks[s].visit |= 1ULL << i;
+        }
+
+        unsigned long long pending = count == 64 ? ~0ULL : (1ULL << count) - 1;
+        for (int level = 0; pending != 0 && !this->frontier.empty(); ++level)
+        {
+            for (int i = 0; i < count; ++i)
+                if (depths[i] <= level)
+                    pending &= ~(1ULL << i);
+
+            this->next.clear();
+            for (int u : this->frontier)
+            {
+                unsigned long long mask = this->masks[u].visit & pending;
+                this->masks[u].visit = 0;
+                if (mask == 0)
+                    continue;
+
+                for (Edge<string> *edge : graph.getVertexNodeById(u)->outEdges())
+                {
+                    Masks &to = this->masks[edge->getTo()->getId()];
+                    unsigned long long add = mask & ~to.seen;
+                    if (add == 0)
+                        continue;
+                    if (to.visitNext == 0)
+                        this->next.push_back(edge->getTo()->getId());
+                    to.visitNext |= add;
+                }
+            }
+
+            sort(this->next.begin(), this->next.end());
+            for (int v : this->next)
+            {
+                unsigned long long fresh = this->masks[v].visitNext;
+                this->masks[v].visitNext = 0;
+                if (this->masks[v].seen == 0)
+                    this->touched.push_back(v);
+                this->masks[v].seen |= fresh;
+                this->masks[v].visit = fresh;
+                for (; fresh != 0; fresh &= fresh - 1)
+                    found[lowestBit(fresh)].push_back(v);
+            }
+            this->frontier.swap(this->next);
+        }
+
+        for (int v : this->touched)
+            this->masks[v] = Masks{0, 0, 0};
+        this->frontier.clear();
+        this->touched.clear();
+    }
+};
+
+// Per-worker state for the independent searches of isReachableBatch
+struct ReachScratch
+{
+    VisitMarker forwardSeen, backwardSeen;
+    vector<VertexNode<string> *> forward, backward, next;
+};
+
+static int batchWorkers(int threads, size_t jobs)
+{
+    int workers = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+    return min<size_t>(workers, max<size_t>(1, jobs));
+}
+
+vector<bool> KnowledgeGraph::isReachableBatch(const vector<pair<string, string>> &queries, int threads)
+{
+    // Resolve every name first so a bad query fails before any work is done
+    int count = queries.size();
+    vector<VertexNode<string> *> froms(count), tos(count);
+    for (int i = 0; i < count; ++i)
+    {
+        froms[i] = this->requireNode(queries[i].first);
+        tos[i] = this->requireNode(queries[i].second);
+    }
+
+    vector<char> reached(count, 0);
+    const size_t block = 16;
+    int workers = batchWorkers(threads, (count + block - 1) / block);
+
+    if (this->reachIndexEnabled)
+    {
+        // Built once up front, then read-only
+        this->refreshReachabilityIndex();
+        this->graph.getWorkerPool().run(workers, count, [&](size_t begin, size_t end, int)
+                    {
+            for (size_t i = begin; i < end; ++i)
+                reached[i] = froms[i] == tos[i] ||
+                             this->reachIndex.isReachable(this->reachIdOf[froms[i]->getId()],
+                                                          this->reachIdOf[tos[i]->getId()]); }, block);
+    }
+    else
+    {
+        vector<ReachScratch> scratch(workers);
+        int bound = this->graph.idBound();
+        this->graph.getWorkerPool().run(workers, count, [&](size_t begin, size_t end, int worker)
+                    {
+            ReachScratch &own = scratch[worker];
+            for (size_t i = begin; i < end; ++i)
+                reached[i] = bidirectionalReach(froms[i], tos[i], bound, own.forwardSeen, own.backwardSeen,
+                                                own.forward, own.backward, own.next); }, block);
+    }
+
+    return vector<bool>(reached.begin(), reached.end());
+}
+
+vector<vector<string>> KnowledgeGraph::getRelatedEntitiesBatch(const vector<pair<string, int>> &queries, int threads)
+{
+    int count = queries.size();
+    vector<int> ids(count);
+    for (int i = 0; i < count; ++i)
+        ids[i] = this->requireNode(queries[i].first)->getId();
+
+    // Equal sources next to each other land in one group and share their
+    // whole traversal
+    vector<int> order(count);
+    for (int i = 0; i < count; ++i)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](int a, int b)
+                { return ids[a] < ids[b]; });
+
+    vector<int> sources(count), depths(count);
+    for (int i = 0; i < count; ++i)
+    {
+        sources[i] = ids[order[i]];
+        depths[i] = queries[order[i]].second;
+    }
+
+    vector<vector<string>> related(count);
+    size_t groups = (count + 63) / 64;
+    int workers = batchWorkers(threads, groups);
+    vector<unique_ptr<MultiSourceBFS>> bfs(workers);
+    int n = this->graph.idBound();
+
+    this->graph.getWorkerPool().run(workers, groups, [&](size_t begin, size_t end, int worker)
+                {
+        if (!bfs[worker])
+            bfs[worker].reset(new MultiSourceBFS(n));
+        vector<int> found[64];
+        for (size_t g = begin; g < end; ++g)
+        {
+            int first = g * 64;
+            int size = min(64, count - first);
+            bfs[worker]->run(this->graph, &sources[first], &depths[first], size, found);
+            for (int i = 0; i < size; ++i)
+            {
+                vector<string> &out = related[order[first + i]];
+                out.reserve(found[i].size());
+                for (int v : found[i])
+                    out.push_back(this->graph.getVertexNodeById(v)->getVertex());
+                found[i].clear();
+            }
+        } }, 1);
+
+    return related;
+}
+
+string KnowledgeGraph::toString()
+{
+    return this->graph.toString();
+}
+
+void KnowledgeGraph::writeTo(ostream &out)
+{
+    this->graph.writeTo(out);
+}
+
+vector<string> KnowledgeGraph::getRelatedEntities(const string &entity, int depth)
+{
+    VertexNode<string> *node = this->requireNode(entity);
+    return this->cachedItems(QueryCache::keyOf(QueryCache::RELATED, node->getId(), depth), [&]()
+                             { return this->getRelatedEntities(entity, KHopOptions(depth)); });
+}
+
+vector<string> KnowledgeGraph::getRelatedEntities(const string &entity, const KHopOptions &options)
+{
+    this->graph.kHopIds(this->requireNode(entity), options, this->relatedScratch);
+
+    vector<string> related;
+    related.reserve(this->relatedScratch.size());
+    for (EntityId id : this->relatedScratch)
+        related.push_back(this->graph.getVertexNodeById(id)->getVertex());
+
+    return related;
+}
+
+void KnowledgeGraph::relatedIds(EntityId start, const KHopOptions &options,
+                                vector<EntityId> &out, vector<double> *distances)
+{
+    this->graph.kHopIds(this->requireNode(start), options, out, distances);
+}
+
+string KnowledgeGraph::findCommonAncestors(const string &entity1, const string &entity2)
+{
+    VertexNode<string> *node1 = this->findNode(entity1);
+    VertexNode<string> *node2 = this->findNode(entity2);
+    if (node1 == nullptr || node2 == nullptr)
+        throw EntityNotFoundException();
+
+    return this->cachedText(QueryCache::keyOf(QueryCache::COMMON_ANCESTORS, node1->getId(), node2->getId()), [&]()
+                            { return this->commonAncestors(node1, node2); });
+}
+
+string KnowledgeGraph::commonAncestors(VertexNode<string> *node1, VertexNode<string> *node2)
+{
+    vector<VertexNode<string> *> a1, a2;
+    vector<int> d1, d2;
+
+    // Ancestors of entity2 become an id-indexed distance table ...
+    reverseLevels(node2, this->ancestorMark, a2, d2);
+    if ((int)this->ancestorDist.size() < this->graph.idBound())
+        this->ancestorDist.resize(this->graph.idBound());
+    for (size_t j = 0; j < a2.size(); ++j)
+        this->ancestorDist[a2[j]->getId()] = d2[j];
+
+    // ... probed in entity1's reverse BFS order, first minimum wins
+    reverseLevels(node1, this->visited, a1, d1);
+
+    VertexNode<string> *best = nullptr;
+    int bestSum = 0;
+
+    for (size_t i = 0; i < a1.size(); ++i)
+    {
+        int id = a1[i]->getId();
+        if (!this->ancestorMark.test(id))
+            continue;
+
+        int sum = d1[i] + this->ancestorDist[id];
+        if (best == nullptr || sum < bestSum)
+        {
+            best = a1[i];
+            bestSum = sum;
+        }
+    }
+
+    if (best == nullptr)
+        return "No common ancestor";
+    return best->getVertex();
+}
+
+void KnowledgeGraph::setEntityPosition(const string &entity, const Point &position)
+{
+    EntityId id = this->requireNode(entity)->getId();
+    if ((int)this->positions.size() <= id)
+    {
+        this->positions.resize(id + 1);
+        this->hasPosition.resize(id + 1, 0);
+    }
+    // Point has a user copy constructor but no copy assignment
+    this->positions[id].setX(position.getX());
+    this->positions[id].setY(position.getY());
+    this->positions[id].setZ(position.getZ());
+    this->hasPosition[id] = 1;
+}
+
+PathResult KnowledgeGraph::shortestPath(const string &from, const string &to)
+{
+    VertexNode<string> *fromNode = this->findNode(from);
+    VertexNode<string> *toNode = this->findNode(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw EntityNotFoundException();
+
+    return this->graph.searchPath(vector<VertexNode<string> *>(1, fromNode), toNode);
+}
+
+PathResult KnowledgeGraph::shortestPathAStar(const string &from, const string &to)
+{
+    VertexNode<string> *fromNode = this->findNode(from);
+    VertexNode<string> *toNode = this->findNode(to);
+    if (fromNode == nullptr || toNode == nullptr)
+        throw EntityNotFoundException();
+
+    DGraphModel<string>::PathHeuristic distance =
+        [this](VertexNode<string> *v, VertexNode<string> *target) -> double
+    {
+        int a = v->getId(), b = target->getId();
+        int known = this->hasPosition.size();
+        if (a >= known || b >= known || !this->hasPosition[a] || !this->hasPosition[b])
+            return 0;
+        return this->positions[a].distanceTo(this->positions[b]);
+    };
+    return this->graph.searchPath(vector<VertexNode<string> *>(1, fromNode), toNode, &distance);
+}
+
+PathResult KnowledgeGraph::shortestPathFromAny(const vector<string> &sources, const string &to)
+{
+    VertexNode<string> *toNode = this->findNode(to);
+    if (toNode == nullptr)
+        throw EntityNotFoundException();
+
+    vector<VertexNode<string> *> sourceNodes;
+    sourceNodes.reserve(sources.size());
+    for (const string &source : sources)
+        sourceNodes.push_back(this->requireNode(source));
+
+    return this->graph.searchPath(sourceNodes, toNode);
+}
+
+CSRGraph<string> KnowledgeGraph::freeze()
+{
+    return this->graph.freeze();
+}
+
+void KnowledgeGraph::sortedPredecessors(VertexNode<string> *node, vector<VertexNode<string> *> &out)
+{
+    // Predecessors in entity (= id) order without duplicates, as a scan over
+    // all entities would list them
+    out.clear();
+    for (Edge<string> *edge : node->inEdges())
+        out.push_back(edge->getFrom());
+
+    sort(out.begin(), out.end(), [](VertexNode<string> *a, VertexNode<string> *b)
+         { return a->getId() < b->getId(); });
+    out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+void KnowledgeGraph::reverseLevels(
+    VertexNode<string> *start,
+    VisitMarker &mark,
+    vector<VertexNode<string> *> &order,
+    vector<int> &dist)
+{
+    order.clear();
+    dist.clear();
+
+    mark.reset(this->graph.idBound());
+    mark.mark(start->getId());
+    order.push_back(start);
+    dist.push_back(0);
+
+    for (size_t idx = 0; idx < order.size(); ++idx)
+    {
+        sortedPredecessors(order[idx], this->predScratch);
+        for (VertexNode<string> *p : this->predScratch)
+        {
+            if (mark.mark(p->getId()))
+            {
+                order.push_back(p);
+                dist.push_back(dist[idx] + 1);
+            }
+        }
+    }
+}
+
+vector<string> KnowledgeGraph::getIncomingNeighbors(const string &target)
+{
+    vector<string> incoming;
+    VertexNode<string> *targetNode = this->findNode(target);
+    if (targetNode == nullptr)
+        return incoming;
+
+    vector<VertexNode<string> *> preds;
+    sortedPredecessors(targetNode, preds);
+
+    incoming.reserve(preds.size());
+    for (VertexNode<string> *p : preds)
+        incoming.push_back(p->getVertex());
+    return incoming;
+}
+
+void KnowledgeGraph::reverseBfsDistances(
+    const string &start,
+    vector<string> &nodes,
+    vector<int> &dist)
+{
+    nodes.clear();
+    dist.clear();
 
-    vector<string> related;
-    vector<string> qNode;
-    vector<int> qDepth;
-    int idx = 0;
+    VertexNode<string> *startNode = this->findNode(start);
+    if (startNode == nullptr)
+        return;
+
+    vector<VertexNode<string> *> order;
+    reverseLevels(startNode, this->visited, order, dist);
+
+    nodes.reserve(order.size());
+    for (VertexNode<string> *node : order)
+        nodes.push_back(node->getVertex());
+}
+
+// =============================================================================
+// Snapshot Format
+// =============================================================================
 
-    qNode.push_back(entity);
-    qDepth.push_back(0);
+static const char SNAPSHOT_MAGIC[8] = {'K', 'G', 'S', 'N', 'A', 'P', '0', '1'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
 
-    while (idx < (int)qNode.size())
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t numVertices;
+    uint64_t numEdges;
+    uint64_t hashSlots;
+    uint64_t nameBytes;
+    uint64_t nameOffsetsAt;
+    uint64_t namesAt;
+    uint64_t hashAt;
+    uint64_t outOffsetsAt;
+    uint64_t outTargetsAt;
+    uint64_t outWeightsAt;
+    uint64_t inOffsetsAt;
+    uint64_t inSourcesAt;
+    uint64_t fileSize;
+};
+
+static_assert(sizeof(int) == 4 && sizeof(float) == 4, "snapshot stores 32-bit ids and weights");
+
+// Stable across processes and builds, unlike std::hash
+static uint64_t snapshotHash(string_view name)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (char c : name)
     {
-        string current = qNode[idx];
-        int currDepth = qDepth[idx];
-        idx++;
+        h ^= (unsigned char)c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
 
-        if (currDepth >= depth)
-            continue;
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t)7;
+}
 
-        vector<Edge<string> *> edges = this->graph.getOutwardEdges(current);
-        for (Edge<string> *edge : edges)
-        {
-            string neighbor = edge->getTo()->getVertex();
-            if (neighbor == entity)
-                continue;
+// Every section must start 8-byte aligned, after the previous one ends,
+// and lie entirely inside the file. numVertices and numEdges are already
+// known to fit in 32 bits, so section sizes cannot overflow.
+static bool snapshotSectionsFit(const SnapshotHeader &header, uint64_t length)
+{
+    uint64_t n = header.numVertices;
+    uint64_t m = header.numEdges;
+    if (header.hashSlots > length / sizeof(uint32_t) || header.nameBytes > length)
+        return false;
 
-            bool existed = false;
-            for (string &s : related)
-            {
-                if (s == neighbor)
-                {
-                    existed = true;
-                    break;
-                }
-            }
+    const uint64_t sections[][2] = {
+        {header.nameOffsetsAt, (n + 1) * sizeof(uint64_t)},
+        {header.namesAt, header.nameBytes},
+        {header.hashAt, header.hashSlots * sizeof(uint32_t)},
+        {header.outOffsetsAt, (n + 1) * sizeof(int32_t)},
+        {header.outTargetsAt, m * sizeof(int32_t)},
+        {header.outWeightsAt, m * sizeof(float)},
+        {header.inOffsetsAt, (n + 1) * sizeof(int32_t)},
+        {header.inSourcesAt, m * sizeof(int32_t)},
+    };
+
+    uint64_t end = sizeof(SnapshotHeader);
+    for (const uint64_t *section : sections)
+    {
+        uint64_t at = section[0], bytes = section[1];
+        if (at % 8 != 0 || at < end || at > length || bytes > length - at)
+            return false;
+        end = at + bytes;
+    }
+    return true;
+}
 
-            if (!existed)
-            {
-                related.push_back(neighbor);
-                qNode.push_back(neighbor);
-                qDepth.push_back(currDepth + 1);
-            }
-        }
+// offsets must run from 0 up to m without decreasing, every id below n
+static bool validAdjacency(const int32_t *offsets, const int32_t *ids, uint64_t n, uint64_t m)
+{
+    if (offsets[0] != 0 || (uint64_t)offsets[n] != m)
+        return false;
+    for (uint64_t v = 0; v < n; ++v)
+    {
+        if (offsets[v + 1] < offsets[v])
+            return false;
+    }
+    for (uint64_t e = 0; e < m; ++e)
+    {
+        if (ids[e] < 0 || (uint64_t)ids[e] >= n)
+            return false;
     }
+    return true;
+}
 
-    return related;
+// Checked once at open so lookups and traversals can trust the arrays;
+// returns what is wrong, or an empty string
+static string snapshotContentProblem(const char *base, const SnapshotHeader &header)
+{
+    uint64_t n = header.numVertices;
+    uint64_t m = header.numEdges;
+
+    const uint64_t *nameOffsets = reinterpret_cast<const uint64_t *>(base + header.nameOffsetsAt);
+    if (nameOffsets[0] != 0 || nameOffsets[n] > header.nameBytes)
+        return "name offsets out of range";
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        if (nameOffsets[i + 1] < nameOffsets[i])
+            return "name offsets out of order";
+    }
+
+    // Lookups probe until an empty slot, so there must be one
+    const uint32_t *hashSlots = reinterpret_cast<const uint32_t *>(base + header.hashAt);
+    bool hasEmpty = false;
+    for (uint64_t h = 0; h < header.hashSlots; ++h)
+    {
+        if (hashSlots[h] > n)
+            return "hash slot out of range";
+        hasEmpty = hasEmpty || hashSlots[h] == 0;
+    }
+    if (!hasEmpty)
+        return "hash table has no empty slot";
+
+    if (!validAdjacency(reinterpret_cast<const int32_t *>(base + header.outOffsetsAt),
+                        reinterpret_cast<const int32_t *>(base + header.outTargetsAt), n, m))
+        return "bad out-edge offsets or targets";
+    if (!validAdjacency(reinterpret_cast<const int32_t *>(base + header.inOffsetsAt),
+                        reinterpret_cast<const int32_t *>(base + header.inSourcesAt), n, m))
+        return "bad in-edge offsets or sources";
+
+    return "";
 }
 
-string KnowledgeGraph::findCommonAncestors(string entity1, string entity2)
+static void writeSection(ofstream &out, uint64_t at, const void *data, uint64_t bytes)
 {
-    if (!this->graph.contains(entity1) || !this->graph.contains(entity2))
-        throw EntityNotFoundException();
+    // Pad up to the section start
+    static const char zeros[8] = {0};
+    uint64_t pos = out.tellp();
+    out.write(zeros, at - pos);
+    if (bytes > 0)
+        out.write(static_cast<const char *>(data), bytes);
+}
 
-    vector<string> a1, a2;
-    vector<int> d1, d2;
+void KnowledgeGraph::saveSnapshot(const string &path)
+{
+    CSRGraph<string> frozen = this->freeze();
+    CSRView csr = frozen.view();
+    uint64_t n = csr.numVertices;
+    uint64_t m = csr.numEdges;
+
+    vector<uint64_t> nameOffsets(n + 1, 0);
+    for (uint64_t i = 0; i < n; ++i)
+        nameOffsets[i + 1] = nameOffsets[i] + frozen.vertexAt(i).size();
+
+    // Load factor at most one half
+    uint64_t slots = 2;
+    while (slots < 2 * n)
+        slots *= 2;
+    vector<uint32_t> hashSlots(slots, 0);
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        uint64_t h = snapshotHash(frozen.vertexAt(i)) & (slots - 1);
+        while (hashSlots[h] != 0)
+            h = (h + 1) & (slots - 1);
+        hashSlots[h] = i + 1;
+    }
 
-    reverseBfsDistances(entity1, a1, d1);
-    reverseBfsDistances(entity2, a2, d2);
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.numVertices = n;
+    header.numEdges = m;
+    header.hashSlots = slots;
+    header.nameBytes = nameOffsets[n];
+    header.nameOffsetsAt = alignUp(sizeof(SnapshotHeader));
+    header.namesAt = alignUp(header.nameOffsetsAt + (n + 1) * sizeof(uint64_t));
+    header.hashAt = alignUp(header.namesAt + header.nameBytes);
+    header.outOffsetsAt = alignUp(header.hashAt + slots * sizeof(uint32_t));
+    header.outTargetsAt = alignUp(header.outOffsetsAt + (n + 1) * sizeof(int32_t));
+    header.outWeightsAt = alignUp(header.outTargetsAt + m * sizeof(int32_t));
+    header.inOffsetsAt = alignUp(header.outWeightsAt + m * sizeof(float));
+    header.inSourcesAt = alignUp(header.inOffsetsAt + (n + 1) * sizeof(int32_t));
+    header.fileSize = header.inSourcesAt + m * sizeof(int32_t);
+
+    // Written beside the target and renamed over it, so readers that have
+    // the old file mapped keep a complete copy and a crash leaves no torn file
+    string tmpPath = path + ".tmp";
+    ofstream out(tmpPath, ios::binary | ios::trunc);
+    if (!out)
+        throw runtime_error("Cannot open " + tmpPath);
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeSection(out, header.nameOffsetsAt, nameOffsets.data(), (n + 1) * sizeof(uint64_t));
+    writeSection(out, header.namesAt, nullptr, 0);
+    for (uint64_t i = 0; i < n; ++i)
+        out.write(frozen.vertexAt(i).data(), frozen.vertexAt(i).size());
+    writeSection(out, header.hashAt, hashSlots.data(), slots * sizeof(uint32_t));
+    writeSection(out, header.outOffsetsAt, csr.outOffsets, (n + 1) * sizeof(int32_t));
+    writeSection(out, header.outTargetsAt, csr.outTargets, m * sizeof(int32_t));
+    writeSection(out, header.outWeightsAt, csr.outWeights, m * sizeof(float));
+    writeSection(out, header.inOffsetsAt, csr.inOffsets, (n + 1) * sizeof(int32_t));
+    writeSection(out, header.inSourcesAt, csr.inSources, m * sizeof(int32_t));
+
+    out.close();
+    if (!out)
+    {
+        std::remove(tmpPath.c_str());
+        throw runtime_error("Cannot write " + tmpPath);
+    }
 
-    string best = "";
-    int bestSum = 0;
+#ifdef _WIN32
+    // rename does not replace an existing file here
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmpPath.c_str());
+        throw runtime_error("Cannot replace " + path);
+    }
+}
 
-    for (int i = 0; i < (int)a1.size(); ++i)
+void KnowledgeGraph::loadSnapshot(const string &path)
+{
+    MappedKnowledgeGraph snapshot(path);
+    CSRView csr = snapshot.view();
+
+    vector<string> names;
+    names.reserve(csr.numVertices);
+    for (int i = 0; i < csr.numVertices; ++i)
+        names.push_back(string(snapshot.getEntityName(i)));
+
+    // addEntities would collapse repeats, check before anything is added
+    unordered_set<string_view> distinct(names.begin(), names.end());
+    if ((int)distinct.size() != csr.numVertices)
+        throw runtime_error("Invalid snapshot: duplicate entity names in " + path);
+
+    // Snapshot id i becomes graph id base + i
+    int base = this->graph.idBound();
+    this->addEntities(names);
+
+    vector<VertexNode<string> *> froms, tos;
+    vector<float> weights(csr.outWeights, csr.outWeights + csr.numEdges);
+    froms.reserve(csr.numEdges);
+    tos.reserve(csr.numEdges);
+    for (int u = 0; u < csr.numVertices; ++u)
     {
-        for (int j = 0; j < (int)a2.size(); ++j)
+        for (int e = csr.outOffsets[u]; e < csr.outOffsets[u + 1]; ++e)
         {
-            if (a1[i] == a2[j])
-            {
-                int sum = d1[i] + d2[j];
-                if (best == "" || sum < bestSum)
-                {
-                    best = a1[i];
-                    bestSum = sum;
-                }
-            }
+            froms.push_back(this->graph.getVertexNodeById(base + u));
+            tos.push_back(this->graph.getVertexNodeById(base + csr.outTargets[e]));
         }
     }
+    this->graph.connectAll(froms, tos, weights);
+}
+
+// =============================================================================
+// Class MappedKnowledgeGraph Implementation
+// =============================================================================
+
+MappedKnowledgeGraph::MappedKnowledgeGraph(const string &path)
+{
+    this->base = nullptr;
+    this->length = 0;
+
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("Cannot open " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader))
+    {
+        close(fd);
+        throw runtime_error("Invalid snapshot: " + path + " is too small");
+    }
+
+    this->length = st.st_size;
+    void *mapped = mmap(nullptr, this->length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        throw runtime_error("Cannot map " + path);
+    this->base = static_cast<const char *>(mapped);
+#else
+    // No mmap: read the whole file into an 8-byte aligned heap buffer
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in)
+        throw runtime_error("Cannot open " + path);
+    this->length = in.tellg();
+    if (this->length < sizeof(SnapshotHeader))
+        throw runtime_error("Invalid snapshot: " + path + " is too small");
+    char *buffer = static_cast<char *>(::operator new(this->length));
+    in.seekg(0);
+    in.read(buffer, this->length);
+    this->base = buffer;
+#endif
+
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(this->base);
+    uint64_t n = header->numVertices;
+    uint64_t m = header->numEdges;
+    string problem;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+        problem = "bad magic";
+    else if (header->byteOrder != SNAPSHOT_BYTE_ORDER)
+        problem = "byte order mismatch";
+    else if (header->version != SNAPSHOT_VERSION)
+        problem = "unsupported version " + to_string(header->version);
+    else if (header->fileSize != this->length || n > INT32_MAX || m > INT32_MAX ||
+             header->inSourcesAt + m * sizeof(int32_t) != header->fileSize ||
+             (header->hashSlots & (header->hashSlots - 1)) != 0 || header->hashSlots < 2)
+        problem = "truncated or inconsistent sections";
+    else if (!snapshotSectionsFit(*header, this->length))
+        problem = "sections misaligned, overlapping or out of bounds";
+    else
+        problem = snapshotContentProblem(this->base, *header);
+
+    if (!problem.empty())
+    {
+        this->unmap();
+        throw runtime_error("Invalid snapshot: " + path + ": " + problem);
+    }
+
+    this->nameOffsets = reinterpret_cast<const unsigned long long *>(this->base + header->nameOffsetsAt);
+    this->names = this->base + header->namesAt;
+    this->hashSlots = reinterpret_cast<const unsigned int *>(this->base + header->hashAt);
+    this->hashMask = header->hashSlots - 1;
+
+    this->csr.numVertices = n;
+    this->csr.numEdges = m;
+    this->csr.outOffsets = reinterpret_cast<const int *>(this->base + header->outOffsetsAt);
+    this->csr.outTargets = reinterpret_cast<const int *>(this->base + header->outTargetsAt);
+    this->csr.outWeights = reinterpret_cast<const float *>(this->base + header->outWeightsAt);
+    this->csr.inOffsets = reinterpret_cast<const int *>(this->base + header->inOffsetsAt);
+    this->csr.inSources = reinterpret_cast<const int *>(this->base + header->inSourcesAt);
+}
+
+MappedKnowledgeGraph::~MappedKnowledgeGraph()
+{
+    this->unmap();
+}
+
+void MappedKnowledgeGraph::unmap()
+{
+    if (this->base == nullptr)
+        return;
+
+#ifndef _WIN32
+    munmap(const_cast<char *>(this->base), this->length);
+#else
+    ::operator delete(const_cast<char *>(this->base));
+#endif
+    this->base = nullptr;
+}
+
+int MappedKnowledgeGraph::size()
+{
+    return this->csr.numVertices;
+}
+
+EntityId MappedKnowledgeGraph::findEntityId(string_view entity)
+{
+    uint64_t h = snapshotHash(entity) & this->hashMask;
+    while (this->hashSlots[h] != 0)
+    {
+        int id = this->hashSlots[h] - 1;
+        if (this->getEntityName(id) == entity)
+            return id;
+        h = (h + 1) & this->hashMask;
+    }
+    return -1;
+}
+
+string_view MappedKnowledgeGraph::getEntityName(EntityId id)
+{
+    if (id < 0 || id >= this->csr.numVertices)
+        throw EntityNotFoundException();
+
+    return string_view(this->names + this->nameOffsets[id],
+                       this->nameOffsets[id + 1] - this->nameOffsets[id]);
+}
+
+int MappedKnowledgeGraph::requireId(string_view entity)
+{
+    int id = this->findEntityId(entity);
+    if (id < 0)
+        throw EntityNotFoundException();
+    return id;
+}
+
+string MappedKnowledgeGraph::formatIds(const vector<int> &ids)
+{
+    string out = "[";
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i > 0)
+            out += ", ";
+        out += this->getEntityName(ids[i]);
+    }
+    out += "]";
+    return out;
+}
+
+vector<string> MappedKnowledgeGraph::getAllEntities()
+{
+    vector<string> entities;
+    entities.reserve(this->csr.numVertices);
+    for (int i = 0; i < this->csr.numVertices; ++i)
+        entities.push_back(string(this->getEntityName(i)));
+    return entities;
+}
+
+vector<string> MappedKnowledgeGraph::getNeighbors(const string &entity)
+{
+    int id = this->requireId(entity);
+
+    vector<string> neighbors;
+    neighbors.reserve(this->csr.outDegree(id));
+    for (int e = this->csr.outOffsets[id]; e < this->csr.outOffsets[id + 1]; ++e)
+        neighbors.push_back(string(this->getEntityName(this->csr.outTargets[e])));
+    return neighbors;
+}
 
-    if (best == "")
+string MappedKnowledgeGraph::bfs(const string &start)
+{
+    return this->formatIds(this->csr.bfsOrder(this->requireId(start)));
+}
+
+string MappedKnowledgeGraph::dfs(const string &start)
+{
+    return this->formatIds(this->csr.dfsOrder(this->requireId(start)));
+}
+
+bool MappedKnowledgeGraph::isReachable(const string &from, const string &to)
+{
+    int fromId = this->findEntityId(from);
+    int toId = this->findEntityId(to);
+    if (fromId < 0 || toId < 0)
+        throw EntityNotFoundException();
+
+    return this->csr.isReachable(fromId, toId);
+}
+
+vector<string> MappedKnowledgeGraph::getRelatedEntities(const string &entity, int depth)
+{
+    int id = this->requireId(entity);
+
+    vector<string> related;
+    for (int v : this->csr.related(id, depth))
+        related.push_back(string(this->getEntityName(v)));
+    return related;
+}
+
+string MappedKnowledgeGraph::findCommonAncestors(const string &entity1, const string &entity2)
+{
+    int a = this->findEntityId(entity1);
+    int b = this->findEntityId(entity2);
+    if (a < 0 || b < 0)
+        throw EntityNotFoundException();
+
+    int best = this->csr.commonAncestor(a, b);
+    if (best < 0)
         return "No common ancestor";
-    return best;
+    return string(this->getEntityName(best));
 }
 
-vector<string> KnowledgeGraph::getIncomingNeighbors(const string &target)
+// =============================================================================
+// Class ConcurrentKnowledgeGraph Implementation
+// =============================================================================
+
+ConcurrentKnowledgeGraph::ConcurrentKnowledgeGraph()
+    : pending(0), autoPublish(0), current(nullptr), readEpoch(0), versionNumber(0)
 {
-    vector<string> incoming;
-    vector<string> all = this->getAllEntities();
+    this->readers[0].store(0);
+    this->readers[1].store(0);
+    // Readers always find a version, even before the first publish
+    this->publishLocked();
+}
+
+ConcurrentKnowledgeGraph::~ConcurrentKnowledgeGraph()
+{
+    delete this->current.load();
+}
 
-    for (string &u : all)
+// Returns once every reader that could still be copying a version
+// published before the call has finished. A reader registers before it
+// loads current, so one seen in neither counter after the store cannot
+// hold the old pointer. Readers arriving meanwhile join the other counter,
+// which keeps a steady stream of them from starving the writer.
+void ConcurrentKnowledgeGraph::waitForReaders()
+{
+    for (int flip = 0; flip < 2; ++flip)
     {
-        vector<Edge<string> *> edges = this->graph.getOutwardEdges(u);
-        for (Edge<string> *edge : edges)
-        {
-            string v = edge->getTo()->getVertex();
-            if (v == target)
-            {
-                bool seen = false;
-                for (string &x : incoming)
-                    if (x == u)
-                    {
-                        seen = true;
-                        break;
-                    }
-                if (!seen)
-                    incoming.push_back(u);
-            }
-        }
+        int epoch = this->readEpoch.load();
+        this->readEpoch.store(1 - epoch);
+        while (this->readers[epoch].load() != 0)
+            this_thread::yield();
     }
-    return incoming;
 }
 
-void KnowledgeGraph::reverseBfsDistances(
-    const string &start,
-    vector<string> &nodes,
-    vector<int> &dist)
+void ConcurrentKnowledgeGraph::publishLocked()
 {
-    nodes.clear();
-    dist.clear();
+    shared_ptr<CSRGraph<string>> *next = new shared_ptr<CSRGraph<string>>(make_shared<CSRGraph<string>>(this->graph.freeze()));
+    shared_ptr<CSRGraph<string>> *previous = this->current.exchange(next);
+    this->versionNumber.fetch_add(1, memory_order_release);
+    this->pending = 0;
 
-    nodes.push_back(start);
-    dist.push_back(0);
+    if (previous)
+    {
+        this->waitForReaders();
+        delete previous;
+    }
+}
 
-    vector<string> q;
-    vector<int> qd;
-    int idx = 0;
+void ConcurrentKnowledgeGraph::changed()
+{
+    this->pending++;
+    if (this->autoPublish > 0 && this->pending >= this->autoPublish)
+        this->publishLocked();
+}
+
+void ConcurrentKnowledgeGraph::addEntity(const string &entity)
+{
+    lock_guard<mutex> lock(this->writeLock);
+    this->graph.addEntity(entity);
+    this->changed();
+}
+
+void ConcurrentKnowledgeGraph::addRelation(const string &from, const string &to, float weight)
+{
+    lock_guard<mutex> lock(this->writeLock);
+    this->graph.addRelation(from, to, weight);
+    this->changed();
+}
+
+void ConcurrentKnowledgeGraph::removeRelation(const string &from, const string &to)
+{
+    lock_guard<mutex> lock(this->writeLock);
+    this->graph.removeRelation(from, to);
+    this->changed();
+}
+
+void ConcurrentKnowledgeGraph::removeEntity(const string &entity)
+{
+    lock_guard<mutex> lock(this->writeLock);
+    this->graph.removeEntity(entity);
+    this->changed();
+}
+
+void ConcurrentKnowledgeGraph::publish()
+{
+    lock_guard<mutex> lock(this->writeLock);
+    if (this->pending > 0)
+        this->publishLocked();
+}
 
-    q.push_back(start);
-    qd.push_back(0);
+void ConcurrentKnowledgeGraph::setAutoPublish(size_t pendingChanges)
+{
+    lock_guard<mutex> lock(this->writeLock);
+    this->autoPublish = pendingChanges;
+}
 
-    vector<string> visited;
-    visited.push_back(start);
+size_t ConcurrentKnowledgeGraph::pendingChanges()
+{
+    lock_guard<mutex> lock(this->writeLock);
+    return this->pending;
+}
 
-    while (idx < (int)q.size())
+void ConcurrentKnowledgeGraph::apply(const function<void(KnowledgeGraph &)> &changes)
+{
+    lock_guard<mutex> lock(this->writeLock);
+    try
+    {
+        changes(this->graph);
+    }
+    catch (...)
     {
-        string current = q[idx];
-        int cd = qd[idx];
-        idx++;
+        this->pending++;
+        throw;
+    }
+    this->publishLocked();
+}
 
-        vector<string> incoming = getIncomingNeighbors(current);
-        for (string &p : incoming)
-        {
-            bool seen = false;
-            for (string &v : visited)
-                if (v == p)
-                {
-                    seen = true;
-                    break;
-                }
-            if (!seen)
-            {
-                visited.push_back(p);
+shared_ptr<CSRGraph<string>> ConcurrentKnowledgeGraph::snapshot() const
+{
+    int epoch = this->readEpoch.load();
+    this->readers[epoch].fetch_add(1);
+    shared_ptr<CSRGraph<string>> version = *this->current.load();
+    this->readers[epoch].fetch_sub(1);
+    return version;
+}
 
-                nodes.push_back(p);
-                dist.push_back(cd + 1);
+unsigned long long ConcurrentKnowledgeGraph::version() const
+{
+    return this->versionNumber.load(memory_order_acquire);
+}
 
-                q.push_back(p);
-                qd.push_back(cd + 1);
-            }
-        }
+int ConcurrentKnowledgeGraph::requireId(CSRGraph<string> &version, const string &entity)
+{
+    string key = entity;
+    int id = version.indexOf(key);
+    if (id < 0)
+        throw EntityNotFoundException();
+    return id;
+}
+
+string ConcurrentKnowledgeGraph::formatIds(CSRGraph<string> &version, const vector<int> &ids)
+{
+    string out = "[";
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i > 0)
+            out += ", ";
+        out += version.vertexAt(ids[i]);
     }
+    out += "]";
+    return out;
+}
+
+int ConcurrentKnowledgeGraph::size() const
+{
+    return this->snapshot()->size();
+}
+
+vector<string> ConcurrentKnowledgeGraph::getAllEntities() const
+{
+    shared_ptr<CSRGraph<string>> version = this->snapshot();
+
+    vector<string> entities;
+    entities.reserve(version->size());
+    for (int i = 0; i < version->size(); ++i)
+        entities.push_back(version->vertexAt(i));
+    return entities;
+}
+
+vector<string> ConcurrentKnowledgeGraph::getNeighbors(const string &entity) const
+{
+    shared_ptr<CSRGraph<string>> version = this->snapshot();
+    int id = requireId(*version, entity);
+    CSRView csr = version->view();
+
+    vector<string> neighbors;
+    neighbors.reserve(csr.outDegree(id));
+    for (int e = csr.outOffsets[id]; e < csr.outOffsets[id + 1]; ++e)
+        neighbors.push_back(version->vertexAt(csr.outTargets[e]));
+    return neighbors;
+}
+
+string ConcurrentKnowledgeGraph::bfs(const string &start) const
+{
+    shared_ptr<CSRGraph<string>> version = this->snapshot();
+    return formatIds(*version, version->view().bfsOrder(requireId(*version, start)));
+}
+
+string ConcurrentKnowledgeGraph::dfs(const string &start) const
+{
+    shared_ptr<CSRGraph<string>> version = this->snapshot();
+    return formatIds(*version, version->view().dfsOrder(requireId(*version, start)));
+}
+
+bool ConcurrentKnowledgeGraph::isReachable(const string &from, const string &to) const
+{
+    shared_ptr<CSRGraph<string>> version = this->snapshot();
+    int fromId = requireId(*version, from);
+    int toId = requireId(*version, to);
+    return version->view().isReachable(fromId, toId);
+}
+
+vector<string> ConcurrentKnowledgeGraph::getRelatedEntities(const string &entity, int depth) const
+{
+    shared_ptr<CSRGraph<string>> version = this->snapshot();
+
+    vector<string> related;
+    for (int v : version->view().related(requireId(*version, entity), depth))
+        related.push_back(version->vertexAt(v));
+    return related;
+}
+
+string ConcurrentKnowledgeGraph::findCommonAncestors(const string &entity1, const string &entity2) const
+{
+    shared_ptr<CSRGraph<string>> version = this->snapshot();
+    int a = requireId(*version, entity1);
+    int b = requireId(*version, entity2);
+
+    int best = version->view().commonAncestor(a, b);
+    if (best < 0)
+        return "No common ancestor";
+    return version->vertexAt(best);
 }
 
 // =============================================================================
@@ -856,7 +4708,22 @@ template class VertexNode<int>;
 template class VertexNode<float>;
 template class VertexNode<char>;
 
+template class DFSWalker<string>;
+template class DFSWalker<int>;
+template class DFSWalker<float>;
+template class DFSWalker<char>;
+
 template class DGraphModel<string>;
 template class DGraphModel<int>;
 template class DGraphModel<float>;
-template class DGraphModel<char>;
\ No newline at end of file
+template class DGraphModel<char>;
+
+template class CSRGraph<string>;
+template class CSRGraph<int>;
+template class CSRGraph<float>;
+template class CSRGraph<char>;
+
+template class DynamicTopology<string>;
+template class DynamicTopology<int>;
+template class DynamicTopology<float>;
+template class DynamicTopology<char>;
@@ -2,12 +2,29 @@
 #define KNOWLEDGEGRAPH_H
 
 #include "main.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
 // Forward declaration
 template <class T>
 class VertexNode;
 template <class T>
 class DGraphModel;
+template <class T>
+class CSRGraph;
+template <class T>
+class DFSWalker;
+class TextWriter;
 
 // =====================================
 // Class Edge
@@ -23,6 +40,15 @@ private:
     VertexNode<T> *to;
     float weight;
 
+    // Insertion stamps within from's and to's adjacency, used to print
+    // the out and in lists of a vertex in the order edges were attached
+    int outSeq;
+    int inSeq;
+
+    // Slots in from->outList and to->inList, for O(1) removal
+    int outPos;
+    int inPos;
+
 public:
     Edge();
 
@@ -31,13 +57,557 @@ public:
     bool equals(Edge<T> *edge);
     static bool edgeEQ(Edge<T> *&edge1, Edge<T> *&edge2);
     string toString();
+    void writeTo(TextWriter &out);
 
+    VertexNode<T> *getFrom() { return from; }
     VertexNode<T> *getTo() { return to; }
+    float getWeight() { return weight; }
 
     friend class VertexNode<T>;
     friend class DGraphModel<T>;
 };
 
+// =====================================
+// Struct EdgeTriple
+// =====================================
+// (from, to, weight) record used by the batch loaders
+template <class T>
+struct EdgeTriple
+{
+    T from;
+    T to;
+    float weight;
+
+    EdgeTriple(T from = T(), T to = T(), float weight = 0) : from(from), to(to), weight(weight) {}
+};
+
+// =====================================
+// Enum EdgePolicy
+// =====================================
+// What connect does when from already has an edge to the same target
+enum EdgePolicy
+{
+    KEEP_MULTI_EDGES, // add another parallel edge (default)
+    OVERWRITE_WEIGHT, // update the existing edge's weight
+    REJECT_DUPLICATES // throw DuplicateEdgeException
+};
+
+// =====================================
+// Struct ParallelBFSOptions
+// =====================================
+// Level-synchronous BFS settings. Each level is expanded top-down (scan the
+// frontier's out-edges) or bottom-up (each unvisited vertex scans its
+// in-edges for a frontier parent), switching with Beamer's alpha/beta rule.
+// Without deterministic, vertices of one level come out in whatever order
+// the threads found them; with it, the result equals the sequential BFS.
+struct ParallelBFSOptions
+{
+    int threads;        // 0 = std::thread::hardware_concurrency()
+    bool deterministic;
+    int alpha;          // go bottom-up when frontier edges > unexplored edges / alpha
+    int beta;           // go back top-down when frontier size < vertices / beta
+                        // (both must be positive, otherwise invalid_argument)
+    int minParallelWork; // levels with fewer frontier vertices run inline
+
+    ParallelBFSOptions(int threads = 0, bool deterministic = false)
+        : threads(threads), deterministic(deterministic), alpha(14), beta(24), minParallelWork(1024) {}
+};
+
+// =====================================
+// Struct PathResult
+// =====================================
+// Cheapest path found by the shortest-path searches: vertex ids from source
+// to target, and the summed edge weight. path is empty when not found.
+struct PathResult
+{
+    bool found;
+    double cost;
+    vector<int> path;
+
+    PathResult() : found(false), cost(0) {}
+};
+
+// =====================================
+// Struct KHopOptions
+// =====================================
+// Bounds for k-hop neighborhood queries. An entity is taken if it is within
+// maxHops hops of the start and, when maxDistance >= 0, some path of at most
+// maxHops edges reaches it with summed weight <= maxDistance. perHopLimit
+// caps the entities taken per hop, maxResults the total (0 = no cap); a
+// capped search only expands through the entities it took.
+struct KHopOptions
+{
+    int maxHops;
+    int perHopLimit;
+    int maxResults;
+    double maxDistance;
+
+    explicit KHopOptions(int maxHops = 2)
+        : maxHops(maxHops), perHopLimit(0), maxResults(0), maxDistance(-1) {}
+};
+
+// =====================================
+// Class ObjectPool
+// =====================================
+// Slab allocator for fixed-size objects. Slots are carved from chunks that
+// double in size, freed slots go on an intrusive free list for reuse, and
+// release() returns all memory in O(chunks) without touching each slot.
+template <class U>
+class ObjectPool
+{
+private:
+    union Slot
+    {
+        Slot *next;
+        alignas(U) unsigned char storage[sizeof(U)];
+    };
+
+    vector<Slot *> chunks;
+    Slot *freeList;
+    int chunkUsed;
+    int chunkSize;
+
+public:
+    ObjectPool() : freeList(nullptr), chunkUsed(0), chunkSize(0) {}
+    ~ObjectPool() { release(); }
+
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    template <class... Args>
+    U *create(Args &&...args)
+    {
+        Slot *slot;
+        if (freeList != nullptr)
+        {
+            slot = freeList;
+            freeList = freeList->next;
+        }
+        else
+        {
+            if (chunks.empty() || chunkUsed == chunkSize)
+            {
+                chunkSize = chunks.empty() ? 64 : min(chunkSize * 2, 1 << 16);
+                chunks.push_back(static_cast<Slot *>(::operator new(sizeof(Slot) * chunkSize)));
+                chunkUsed = 0;
+            }
+            slot = chunks.back() + chunkUsed++;
+        }
+        return new (slot->storage) U(std::forward<Args>(args)...);
+    }
+
+    void destroy(U *obj)
+    {
+        obj->~U();
+        Slot *slot = reinterpret_cast<Slot *>(obj);
+        slot->next = freeList;
+        freeList = slot;
+    }
+
+    // Drops every slot at once; live objects must already be destroyed or
+    // be trivially destructible
+    void release()
+    {
+        for (Slot *chunk : chunks)
+            ::operator delete(chunk);
+        chunks.clear();
+        freeList = nullptr;
+        chunkUsed = 0;
+        chunkSize = 0;
+    }
+};
+
+// =====================================
+// Class VisitMarker
+// =====================================
+// Epoch-stamped visited set over dense vertex ids. reset() starts a new
+// traversal in O(1) (the buffer only grows), so one marker can be reused
+// across queries without clearing or reallocating.
+class VisitMarker
+{
+private:
+    vector<unsigned int> stamp;
+    unsigned int epoch;
+
+public:
+    VisitMarker() : epoch(0) {}
+
+    void reset(int n)
+    {
+        if ((int)stamp.size() < n)
+            stamp.resize(n, 0);
+
+        if (++epoch == 0)
+        {
+            // Wrapped around: old stamps could alias the new epoch
+            stamp.assign(stamp.size(), 0);
+            epoch = 1;
+        }
+    }
+
+    bool test(int id) const { return stamp[id] == epoch; }
+
+    // Marks id, returns false if it was already marked in this epoch
+    bool mark(int id)
+    {
+        if (stamp[id] == epoch)
+            return false;
+        stamp[id] = epoch;
+        return true;
+    }
+};
+
+// =====================================
+// Class DaryHeap
+// =====================================
+// Indexed 4-ary min-heap of ids in [0, n) keyed by double. slot[id] is the
+// id's heap position or -1, which makes decrease-key O(log n).
+class DaryHeap
+{
+private:
+    vector<int> heap;
+    vector<double> key;
+    vector<int> slot;
+
+    void place(int i, int id)
+    {
+        heap[i] = id;
+        slot[id] = i;
+    }
+
+    void siftUp(int i)
+    {
+        int id = heap[i];
+        while (i > 0)
+        {
+            int parent = (i - 1) / 4;
+            if (key[heap[parent]] <= key[id])
+                break;
+            place(i, heap[parent]);
+            i = parent;
+        }
+        place(i, id);
+    }
+
+    void siftDown(int i)
+    {
+        int id = heap[i];
+        int n = heap.size();
+        while (true)
+        {
+            int best = -1;
+            double bestKey = key[id];
+            for (int c = 4 * i + 1; c <= 4 * i + 4 && c < n; ++c)
+            {
+                if (key[heap[c]] < bestKey)
+                {
+                    best = c;
+                    bestKey = key[heap[c]];
+                }
+            }
+            if (best < 0)
+                break;
+            place(i, heap[best]);
+            i = best;
+        }
+        place(i, id);
+    }
+
+public:
+    // Empties the heap and makes room for ids below n
+    void reset(int n)
+    {
+        for (int id : heap)
+            slot[id] = -1;
+        heap.clear();
+        if ((int)slot.size() < n)
+        {
+            slot.resize(n, -1);
+            key.resize(n);
+        }
+    }
+
+    bool empty() const { return heap.empty(); }
+
+    // Inserts id, or lowers its key if it is queued with a larger one
+    void pushOrDecrease(int id, double k)
+    {
+        if (slot[id] >= 0)
+        {
+            if (k < key[id])
+            {
+                key[id] = k;
+                siftUp(slot[id]);
+            }
+            return;
+        }
+        key[id] = k;
+        heap.push_back(id);
+        siftUp(heap.size() - 1);
+    }
+
+    int pop()
+    {
+        int top = heap[0];
+        slot[top] = -1;
+        int last = heap.back();
+        heap.pop_back();
+        if (!heap.empty())
+        {
+            place(0, last);
+            siftDown(0);
+        }
+        return top;
+    }
+};
+
+// =====================================
+// Class WorkerPool
+// =====================================
+// Helper threads kept alive between parallel loops, so a level-synchronous
+// traversal or a batch pays for thread creation once rather than per call.
+// run() splits [0, count) into blocks pulled from a shared counter and
+// hands them to body(begin, end, worker) on the calling thread (worker 0)
+// plus threads - 1 helpers, which are started the first time they are
+// needed. Calls are serialized; body must not call run() on the same pool.
+class WorkerPool
+{
+public:
+    typedef function<void(size_t, size_t, int)> Body;
+
+private:
+    vector<thread> helpers;
+    mutex runLock;
+
+    // Current job, guarded by jobLock except for the block counter
+    mutex jobLock;
+    condition_variable wake, finished;
+    unsigned long long jobNumber;
+    int jobHelpers;
+    int pending;
+    bool stopping;
+    const Body *body;
+    size_t count;
+    size_t block;
+    atomic<size_t> next;
+
+    void helperLoop(int id);
+    void work(int id);
+
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void run(int threads, size_t count, const Body &body, size_t block = 256);
+};
+
+// =====================================
+// Class TextWriter
+// =====================================
+// Append-only text buffer behind the toString serializers. Without a sink
+// everything accumulates in str(). With one, flushIfFull() hands the buffer
+// to the sink once it reaches chunkSize, so a dump never sits in memory
+// whole. Numbers go through to_chars.
+class TextWriter
+{
+private:
+    string buffer;
+    ostream *sink;
+    size_t chunkSize;
+
+public:
+    explicit TextWriter(ostream *sink = nullptr, size_t chunkSize = 1 << 16);
+    ~TextWriter();
+
+    void reserve(size_t bytes) { buffer.reserve(bytes); }
+    void put(char c) { buffer.push_back(c); }
+    void append(string_view text) { buffer.append(text.data(), text.size()); }
+    void appendInt(long long value);
+    // Same text as to_string(value)
+    void appendFixed(float value);
+    // Same text as ostream << value with default flags
+    void appendGeneral(float value);
+
+    void flushIfFull()
+    {
+        if (sink != nullptr && buffer.size() >= chunkSize)
+            flush();
+    }
+    void flush();
+
+    string &str() { return buffer; }
+};
+
+// =====================================
+// Class EdgeIndex
+// =====================================
+// Open-addressing table from a (from id, to id) pair to the oldest edge
+// between them and the number of parallel edges. Linear probing with
+// backward-shift deletion (no tombstones), grown at 3/4 load. Slot
+// pointers are invalidated by insert().
+template <class T>
+class EdgeIndex
+{
+public:
+    struct Slot
+    {
+        unsigned long long key;
+        Edge<T> *first;
+        int count;
+    };
+
+    static unsigned long long keyOf(int from, int to)
+    {
+        return ((unsigned long long)(unsigned)from << 32) | (unsigned)to;
+    }
+
+private:
+    static const unsigned long long EMPTY = ~0ULL;
+
+    vector<Slot> slots;
+    size_t used;
+
+    size_t home(unsigned long long key) const
+    {
+        // MurmurHash3 finalizer
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key & (slots.size() - 1);
+    }
+
+    void rehash(size_t capacity)
+    {
+        vector<Slot> old;
+        old.swap(slots);
+        slots.assign(capacity, Slot{EMPTY, nullptr, 0});
+        for (const Slot &slot : old)
+        {
+            if (slot.key == EMPTY)
+                continue;
+            size_t i = home(slot.key);
+            while (slots[i].key != EMPTY)
+                i = (i + 1) & (slots.size() - 1);
+            slots[i] = slot;
+        }
+    }
+
+public:
+    EdgeIndex() : used(0) {}
+
+    size_t size() const { return used; }
+
+    Slot *find(unsigned long long key)
+    {
+        if (used == 0)
+            return nullptr;
+        for (size_t i = home(key);; i = (i + 1) & (slots.size() - 1))
+        {
+            if (slots[i].key == key)
+                return &slots[i];
+            if (slots[i].key == EMPTY)
+                return nullptr;
+        }
+    }
+
+    // key must not be present
+    void insert(unsigned long long key, Edge<T> *edge)
+    {
+        if ((used + 1) * 4 > slots.size() * 3)
+            rehash(slots.empty() ? 16 : slots.size() * 2);
+
+        size_t i = home(key);
+        while (slots[i].key != EMPTY)
+            i = (i + 1) & (slots.size() - 1);
+        slots[i] = Slot{key, edge, 1};
+        used++;
+    }
+
+    // Pulls later entries of the probe run back into the hole
+    void erase(Slot *slot)
+    {
+        size_t mask = slots.size() - 1;
+        size_t hole = slot - slots.data();
+        for (size_t j = (hole + 1) & mask; slots[j].key != EMPTY; j = (j + 1) & mask)
+        {
+            size_t k = home(slots[j].key);
+            bool movable = hole <= j ? (k <= hole || k > j) : (k <= hole && k > j);
+            if (movable)
+            {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole].key = EMPTY;
+        used--;
+    }
+
+    void reserve(size_t count)
+    {
+        size_t capacity = slots.empty() ? 16 : slots.size();
+        while (count * 4 > capacity * 3)
+            capacity *= 2;
+        if (capacity != slots.size())
+            rehash(capacity);
+    }
+
+    void clear()
+    {
+        slots.clear();
+        used = 0;
+    }
+};
+
+// =====================================
+// Class EdgeRange
+// =====================================
+// Non-owning view over a run of edge pointers, iterated without copying.
+// Iteration steps over the nullptr holes that removed edges leave behind.
+template <class T>
+class EdgeRange
+{
+private:
+    Edge<T> *const *first;
+    Edge<T> *const *last;
+
+public:
+    class iterator
+    {
+    private:
+        Edge<T> *const *at;
+        Edge<T> *const *last;
+
+        void skipHoles()
+        {
+            while (at != last && *at == nullptr)
+                ++at;
+        }
+
+    public:
+        iterator(Edge<T> *const *at, Edge<T> *const *last) : at(at), last(last) { skipHoles(); }
+
+        Edge<T> *operator*() const { return *at; }
+        iterator &operator++()
+        {
+            ++at;
+            skipHoles();
+            return *this;
+        }
+        bool operator!=(const iterator &other) const { return at != other.at; }
+    };
+
+    EdgeRange(Edge<T> *const *first, Edge<T> *const *last) : first(first), last(last) {}
+
+    iterator begin() const { return iterator(first, last); }
+    iterator end() const { return iterator(last, last); }
+    bool empty() const { return !(begin() != end()); }
+};
+
 // =====================================
 // Class VertexNode
 // =====================================
@@ -49,9 +619,25 @@ class VertexNode
 #endif
 private:
     T vertex;
+    int id;
     int inDegree_;
     int outDegree_;
-    vector<Edge<T> *> adList;
+
+    // Edges leaving and entering this vertex; an edge lives in its source's
+    // outList and its target's inList
+    vector<Edge<T> *> outList;
+    vector<Edge<T> *> inList;
+    int adCount;
+
+    // Removed edges leave nullptr holes so the rest keep their order; a
+    // list is compacted once its holes outnumber its edges
+    int outHoles;
+    int inHoles;
+    void detachOut(Edge<T> *edge);
+    void detachIn(Edge<T> *edge);
+
+    // Owning graph, edges come from its pool (nullptr for a standalone node)
+    DGraphModel<T> *graph;
 
     // Function pointers
     bool (*vertexEQ)(T &, T &);
@@ -61,6 +647,7 @@ public:
     VertexNode(T vertex, bool (*vertexEQ)(T &, T &) = nullptr, string (*vertex2str)(T &) = nullptr);
 
     T &getVertex();
+    int getId() { return id; }
     void connect(VertexNode<T> *to, float weight = 0);
     Edge<T> *getEdge(VertexNode<T> *to);
     bool equals(VertexNode<T> *node);
@@ -68,11 +655,106 @@ public:
     int inDegree();
     int outDegree();
     string toString();
+    void writeTo(TextWriter &out);
 
     vector<Edge<T> *> getOutwardEdges();
+    EdgeRange<T> outEdges() { return EdgeRange<T>(outList.data(), outList.data() + outList.size()); }
+    EdgeRange<T> inEdges() { return EdgeRange<T>(inList.data(), inList.data() + inList.size()); }
 
     friend class Edge<T>;
     friend class DGraphModel<T>;
+    friend class DFSWalker<T>;
+};
+
+// =====================================
+// Class DFSWalker
+// =====================================
+// Depth-first traversal driven by an explicit stack of (vertex, next edge)
+// frames instead of recursion, so chain length is bounded by heap memory
+// rather than the call stack. Vertices come out in the same order as the
+// recursive definition. next() yields one vertex at a time, so a caller can
+// stop and resume a walk at any point. The walker must not outlive or
+// observe mutations of the graph it walks.
+template <class T>
+class DFSWalker
+{
+private:
+    VisitMarker visited;
+    vector<pair<VertexNode<T> *, int>> stack;
+    VertexNode<T> *pending;
+
+public:
+    DFSWalker();
+
+    // Starts a new walk; buffers from previous walks are reused
+    void start(VertexNode<T> *startNode, int idBound);
+    // Next vertex in DFS order, nullptr once the walk is finished
+    VertexNode<T> *next();
+    bool done();
+    int depth();
+};
+
+// =====================================
+// Class GraphObserver
+// =====================================
+// Hook for structures derived from a DGraphModel. An attached observer is
+// told about every change right after it is made, by VertexNode id.
+// Removing a vertex reports each of its edges first, while the vertex is
+// being torn down, so those callbacks should not read the graph. clear()
+// reports only graphCleared. Callbacks must not modify the graph.
+class GraphObserver
+{
+public:
+    virtual ~GraphObserver() {}
+
+    virtual void vertexAdded(int /*id*/) {}
+    virtual void vertexRemoved(int /*id*/) {}
+    virtual void edgeAdded(int /*from*/, int /*to*/, float /*weight*/) {}
+    virtual void edgeRemoved(int /*from*/, int /*to*/) {}
+    // An existing edge took a new weight (OVERWRITE_WEIGHT policy)
+    virtual void weightChanged(int /*from*/, int /*to*/, float /*weight*/) {}
+    virtual void graphCleared() {}
+};
+
+// One recorded change, from and to are -1 where they do not apply
+struct GraphChange
+{
+    enum Kind
+    {
+        VERTEX_ADDED,
+        VERTEX_REMOVED,
+        EDGE_ADDED,
+        EDGE_REMOVED,
+        WEIGHT_CHANGED,
+        CLEARED
+    };
+
+    Kind kind;
+    int from;
+    int to;
+    float weight;
+
+    GraphChange(Kind kind, int from = -1, int to = -1, float weight = 0)
+        : kind(kind), from(from), to(to), weight(weight) {}
+};
+
+// Observer that queues changes for consumers that catch up in batches
+class GraphChangeLog : public GraphObserver
+{
+private:
+    vector<GraphChange> changes;
+
+public:
+    void vertexAdded(int id) override;
+    void vertexRemoved(int id) override;
+    void edgeAdded(int from, int to, float weight) override;
+    void edgeRemoved(int from, int to) override;
+    void weightChanged(int from, int to, float weight) override;
+    void graphCleared() override;
+
+    const vector<GraphChange> &pending() const { return changes; }
+    // Moves the queued changes into out (replacing its contents)
+    void drain(vector<GraphChange> &out);
 };
 
 // =====================================
@@ -85,51 +767,482 @@ class DGraphModel
     friend class TestHelper;
 #endif
 private:
+    // Indexed by vertex id; a removed vertex leaves nullptr so ids stay stable
     vector<VertexNode<T> *> nodeList;
+    int liveCount;
+
+    // Hash index over nodeList (hash of vertex -> node), nodeList keeps insertion order
+    unordered_multimap<size_t, VertexNode<T> *> nodeIndex;
+
+    // Storage for every vertex and edge of this graph
+    ObjectPool<VertexNode<T>> nodePool;
+    ObjectPool<Edge<T>> edgePool;
+
+    // Reused by BFS/DFS, indexed by VertexNode::id
+    VisitMarker visited;
+    DFSWalker<T> walker;
+    vector<int> orderScratch;
+
+    // Edge lookups by (from, to) never scan an adjacency list
+    EdgeIndex<T> edgeIndex;
+    EdgePolicy edgePolicy;
+
+    // Bumped by every vertex or edge change, lets derived indexes detect staleness
+    unsigned long long generation;
+
+    // Reused by the shortest-path searches, indexed by VertexNode::id
+    VisitMarker pathReached;
+    vector<double> pathDist;
+    vector<double> pathEstimate;
+    vector<int> pathParent;
+    DaryHeap pathHeap;
+
+    // Weighted kHopIds: vertices already queued for the next round
+    VisitMarker roundQueued;
+
+    // Notified of every change, see GraphObserver
+    vector<GraphObserver *> observers;
+
+    // Threads for the parallel traversals, started on first use
+    WorkerPool workerPool;
 
     // Function pointers
     bool (*vertexEQ)(T &, T &);
     string (*vertex2str)(T &);
+    size_t (*vertexHash)(T &);
+
+    bool isIndexed();
+    size_t hashOf(T &vertex);
+    bool matches(VertexNode<T> *node, T &vertex);
+    void weightedKHopIds(VertexNode<T> *startNode, const KHopOptions &options,
+                         vector<int> &out, vector<double> *distances);
 
 public:
-    DGraphModel(bool (*vertexEQ)(T &, T &) = nullptr, string (*vertex2str)(T &) = nullptr);
+    DGraphModel(bool (*vertexEQ)(T &, T &) = nullptr,
+                string (*vertex2str)(T &) = nullptr,
+                size_t (*vertexHash)(T &) = nullptr);
     ~DGraphModel();
 
+    // Vertices and edges live in the graph's pools
+    DGraphModel(const DGraphModel<T> &) = delete;
+    DGraphModel<T> &operator=(const DGraphModel<T> &) = delete;
+
     VertexNode<T> *getVertexNode(T &vertex);
     string vertex2Str(VertexNode<T> &node);
     string edge2Str(Edge<T> &edge);
 
     void add(T vertex);
     bool contains(T vertex);
+
+    // Detaches every incident edge in O(degree) and frees the vertex. Its
+    // id is never reused; getVertexNodeById returns nullptr for it.
+    void remove(T vertex);
+    void removeNode(VertexNode<T> *node);
+
+    // Batch loading: storage is sized once, endpoints are checked up front
+    // and nothing is connected if any of them is missing
+    void reserve(int vertexCount);
+    void addAll(const vector<T> &vertices);
+    void connectAll(const vector<EdgeTriple<T>> &edges);
+    void connectAll(const vector<VertexNode<T> *> &froms,
+                    const vector<VertexNode<T> *> &tos,
+                    const vector<float> &weights);
     float weight(T from, T to);
     vector<Edge<T> *> getOutwardEdges(T from);
 
     void connect(T from, T to, float weight = 0);
     void disconnect(T from, T to);
+
+    void setEdgePolicy(EdgePolicy policy);
+    EdgePolicy getEdgePolicy();
     bool connected(T from, T to);
 
     int size();
     bool empty();
     void clear();
 
+    // Vertex ids are dense and stable, all of them lie in [0, idBound())
+    int idBound();
+    unsigned long long getGeneration();
+    VertexNode<T> *getVertexNodeById(int id);
+
+    // Shared by this graph's parallel traversals and batch queries
+    WorkerPool &getWorkerPool();
+
+    // Observers are not owned; remove one before destroying it
+    void addObserver(GraphObserver *observer);
+    void removeObserver(GraphObserver *observer);
+
     int inDegree(T vertex);
     int outDegree(T vertex);
     vector<T> vertices();
 
     string toString();
+    // Streams toString()'s text to out in chunks of about chunkSize bytes
+    void writeTo(ostream &out, size_t chunkSize = 1 << 16);
+    void writeTo(TextWriter &out);
     string BFS(T start);
     string DFS(T start);
+    string BFSFrom(VertexNode<T> *startNode);
+    string DFSFrom(VertexNode<T> *startNode);
+
+    // Traversals without formatting. The id forms overwrite out with vertex
+    // ids in visiting order, reusing its capacity. The visitor forms stop
+    // as soon as visit returns false; visit must not traverse this graph.
+    // formatIds renders ids the way BFS/DFS print them.
+    typedef function<bool(VertexNode<T> *)> Visitor;
+    void bfsIds(VertexNode<T> *startNode, vector<int> &out);
+    void dfsIds(VertexNode<T> *startNode, vector<int> &out);
+    void visitBFS(VertexNode<T> *startNode, const Visitor &visit);
+    void visitDFS(VertexNode<T> *startNode, const Visitor &visit);
+    string formatIds(const vector<int> &ids);
+
+    // Vertices around startNode (itself excluded), hop by hop. Within a hop
+    // they are in BFS order, or in order of discovery with maxDistance set.
+    // distances, if given, gets each one's hop count or weighted distance.
+    void kHopIds(VertexNode<T> *startNode, const KHopOptions &options,
+                 vector<int> &out, vector<double> *distances = nullptr);
+
+    // Weighted shortest paths over the stored edge weights; a negative weight
+    // on the explored part of the graph throws NegativeWeightException.
+    // A*'s heuristic(v, target) must never overestimate the remaining cost.
+    // searchPath takes several sources (the nearest one wins) and an optional
+    // heuristic, the other three are shorthands for it.
+    typedef function<double(VertexNode<T> *, VertexNode<T> *)> PathHeuristic;
+    PathResult searchPath(const vector<VertexNode<T> *> &sources,
+                          VertexNode<T> *target,
+                          const PathHeuristic *heuristic = nullptr);
+    PathResult shortestPath(T from, T to);
+    PathResult shortestPathAStar(T from, T to, const PathHeuristic &heuristic);
+    PathResult shortestPathFromAny(const vector<T> &sources, T to);
+
+    // Immutable compressed sparse row copy of the current graph
+    CSRGraph<T> freeze();
+
+    // Multi-threaded BFS. The graph must not be modified while it runs.
+    // stopAt (optional) ends the search after the level that reaches it.
+    vector<VertexNode<T> *> parallelBFSOrder(VertexNode<T> *startNode,
+                                             const ParallelBFSOptions &options,
+                                             VertexNode<T> *stopAt = nullptr);
+    string parallelBFS(T start, const ParallelBFSOptions &options = ParallelBFSOptions());
+    bool parallelReachable(T from, T to, const ParallelBFSOptions &options = ParallelBFSOptions());
+
+    friend class VertexNode<T>;
+};
+
+// =====================================
+// Class CSRView
+// =====================================
+// Read-only compressed sparse row adjacency over dense vertex ids [0, n).
+// Out-edges of v are outTargets[outOffsets[v] .. outOffsets[v + 1]) in the
+// order they were stored in the graph; in-edges list their sources in
+// ascending id order. The view does not own its arrays.
+class CSRView
+{
+public:
+    int numVertices;
+    int numEdges;
+    const int *outOffsets;
+    const int *outTargets;
+    const float *outWeights;
+    const int *inOffsets;
+    const int *inSources;
+
+    CSRView();
+
+    int outDegree(int v) const { return outOffsets[v + 1] - outOffsets[v]; }
+    int inDegree(int v) const { return inOffsets[v + 1] - inOffsets[v]; }
+
+    vector<int> bfsOrder(int start) const;
+    vector<int> dfsOrder(int start) const;
+    bool isReachable(int from, int to) const;
+    vector<int> related(int start, int depth) const;
+    // Ancestor of both a and b with the smallest summed distance, -1 if none
+    int commonAncestor(int a, int b) const;
+
+private:
+    void reverseDistances(int start, vector<int> &order, vector<int> &dist) const;
+};
+
+// =====================================
+// Class CSRGraph
+// =====================================
+// Frozen snapshot produced by DGraphModel::freeze(). Vertices get dense ids
+// in nodeList order, skipping removed ones, so the ids match the source
+// graph's only while nothing was removed. Later changes to the source graph
+// are not reflected.
+template <class T>
+class CSRGraph
+{
+#ifdef TESTING
+    friend class TestHelper;
+#endif
+private:
+    vector<T> vertexList;
+    vector<int> outOffsets;
+    vector<int> outTargets;
+    vector<float> outWeights;
+    vector<int> inOffsets;
+    vector<int> inSources;
+
+    unordered_multimap<size_t, int> vertexIndex;
+
+    // Function pointers (copied from the source graph)
+    bool (*vertexEQ)(T &, T &);
+    string (*vertex2str)(T &);
+    size_t (*vertexHash)(T &);
+
+    bool isIndexed();
+    size_t hashOf(T &vertex);
+    bool matches(int id, T &vertex);
+    string formatIds(const vector<int> &ids);
+
+public:
+    CSRGraph(bool (*vertexEQ)(T &, T &) = nullptr,
+             string (*vertex2str)(T &) = nullptr,
+             size_t (*vertexHash)(T &) = nullptr);
+
+    CSRView view() const;
+
+    int size();
+    int indexOf(T &vertex);
+    T &vertexAt(int id);
+    string vertex2Str(int id);
+
+    string BFS(T start);
+    string DFS(T start);
+    bool isReachable(T from, T to);
+    vector<T> getRelatedEntities(T start, int depth = 2);
+    string findCommonAncestors(T vertex1, T vertex2);
+
+    friend class DGraphModel<T>;
+};
+
+// =====================================
+// Class ReachabilityIndex
+// =====================================
+// Answers reachability without traversal. Tarjan's algorithm collapses each
+// strongly connected component to one node of a DAG; component ids come out
+// in reverse topological order, so an edge always goes from a higher id to
+// a lower one and from < to is an immediate "no". The DAG then gets pruned
+// 2-hop labels: a reaches b iff some hub is in both outHubs(a) and inHubs(b).
+class ReachabilityIndex
+{
+private:
+    int numVertices;
+    int numComponents;
+    vector<int> component;
+
+    // Hub ranks per component, ascending
+    vector<int> outOffsets, outHubs;
+    vector<int> inOffsets, inHubs;
+
+    bool sharesHub(int fromComponent, int toComponent) const;
+
+public:
+    ReachabilityIndex();
+
+    void build(const CSRView &graph);
+    void clear();
+
+    int size() const { return numVertices; }
+    int componentCount() const { return numComponents; }
+    int componentOf(int v) const { return component[v]; }
+    long long labelCount() const { return outHubs.size() + inHubs.size(); }
+
+    bool isReachable(int from, int to) const;
+};
+
+// =====================================
+// Class DynamicTopology
+// =====================================
+// Strongly connected components and a topological order of them, kept up
+// to date as the observed graph changes. An added edge that already agrees
+// with the order costs O(1); otherwise Pearce-Kelly reorders only the
+// components between its endpoints, merging them into one when the edge
+// closes a cycle. Removals can split a component, which needs a global
+// view: a removed edge inside a component (or a removed vertex of one)
+// marks the structure stale and the next query recomputes it with Tarjan.
+// Removed edges between components never invalidate the order. Once the
+// reorders since the last recomputation have scanned about as many edges
+// as the graph has, the next one gives up and marks it stale as well, so
+// upkeep never costs much more than recomputing. Changes made while stale
+// cost nothing.
+template <class T>
+class DynamicTopology : public GraphObserver
+{
+private:
+    DGraphModel<T> *graph;
+
+    // Union-find over vertex ids, a component is named by its root; order
+    // and members are only meaningful at roots. Orders may have gaps.
+    vector<int> parent;
+    vector<int> order;
+    vector<vector<int>> members;
+    int nextOrder;
+    int componentTotal;
+    int selfLoops;
+    long long edgeTotal;
+    long long searchWork;
+    bool stale;
+    int rebuildTotal;
+
+    // Pearce-Kelly scratch, indexed by component root
+    VisitMarker forwardMark, backwardMark;
+    vector<int> forwardSet, backwardSet, stack, pool;
+
+    int find(int id);
+    void grow(int idBound);
+    void refresh();
+    void rebuild();
+    void reorder(int fromRoot, int toRoot);
+    int merge(const vector<int> &roots);
+
+public:
+    // Attaches to graph and computes the components of its current state;
+    // detaches when destroyed, so it must not outlive the graph
+    explicit DynamicTopology(DGraphModel<T> &graph);
+    ~DynamicTopology();
+
+    DynamicTopology(const DynamicTopology<T> &) = delete;
+    DynamicTopology<T> &operator=(const DynamicTopology<T> &) = delete;
+
+    void vertexAdded(int id) override;
+    void vertexRemoved(int id) override;
+    void edgeAdded(int from, int to, float weight) override;
+    void edgeRemoved(int from, int to) override;
+    void graphCleared() override;
 
-    void DFS_helper(
-        VertexNode<T> *u,
-        vector<VertexNode<T> *> &visited,
-        stringstream &ss,
-        bool &first);
+    // Component of a live vertex, named by one of its members' ids
+    int componentOf(int id);
+    int componentCount();
+    bool isAcyclic();
+    // false means there is no path from -> to. true is certain within a
+    // component, otherwise it only means the order allows one.
+    bool mayReach(int from, int to);
+    // Live vertex ids, every edge between components pointing forward;
+    // members of a component are adjacent
+    void topologicalOrder(vector<int> &out);
+
+    bool isStale() const { return stale; }
+    // Full recomputations so far, the constructor's included
+    int rebuilds() const { return rebuildTotal; }
+};
+
+// =====================================
+// Class QueryCache
+// =====================================
+// Bounded least-recently-used map from a query and its arguments to the
+// answer. Arguments are EntityIds (and a depth), so the id overloads probe
+// it without touching names. Answers hold for one graph generation: sync()
+// with a newer one drops them all. A capacity of 0 turns the cache off.
+struct QueryCacheStats
+{
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long invalidations;
+    size_t entries;
+    size_t capacity;
+
+    QueryCacheStats() : hits(0), misses(0), evictions(0), invalidations(0), entries(0), capacity(0) {}
+
+    double hitRate() const;
+    string toString() const;
+};
+
+class QueryCache
+{
+public:
+    enum Query
+    {
+        BFS,
+        RELATED,
+        COMMON_ANCESTORS
+    };
+
+    // Answers are either one string or a list of names
+    struct Result
+    {
+        string text;
+        vector<string> items;
+    };
+
+    struct Key
+    {
+        Query query;
+        int first;
+        int second;
+
+        bool operator==(const Key &other) const
+        {
+            return query == other.query && first == other.first && second == other.second;
+        }
+    };
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const
+        {
+            unsigned long long packed = ((unsigned long long)(unsigned)key.first << 32) | (unsigned)key.second;
+            return std::hash<unsigned long long>()(packed * 0x9E3779B97F4A7C15ULL + key.query);
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        Result result;
+    };
+
+    // Most recently used first
+    list<Entry> entries;
+    unordered_map<Key, list<Entry>::iterator, KeyHash> index;
+    size_t capacity;
+    unsigned long long generation;
+    QueryCacheStats stats;
+
+public:
+    QueryCache();
+
+    static Key keyOf(Query query, int first, int second = 0);
+
+    bool enabled() const { return capacity > 0; }
+    void setCapacity(size_t capacity);
+    void clear();
+    void sync(unsigned long long generation);
+
+    // nullptr on a miss; a hit becomes the most recently used entry
+    const Result *find(const Key &key);
+    void insert(const Key &key, const Result &result);
+
+    QueryCacheStats getStats() const;
 };
 
 // =====================================
 // Class KnowledgeGraph
 // =====================================
+// Entities are interned once: the name is stored only in its VertexNode and
+// EntityId is that vertex's dense id. Id overloads skip name lookups.
+typedef int EntityId;
+typedef EdgeTriple<string> Relation;
+
+// Counters returned by the streaming loaders
+struct LoadStats
+{
+    long long entities;
+    long long relations;
+    long long lines;
+    long long bytes;
+    double seconds;
+
+    LoadStats() : entities(0), relations(0), lines(0), bytes(0), seconds(0) {}
+
+    double triplesPerSecond() const;
+    string toString() const;
+};
+
 class KnowledgeGraph
 {
 #ifdef TESTING
@@ -137,25 +1250,175 @@ class KnowledgeGraph
 #endif
 private:
     DGraphModel<string> graph;
-    vector<string> entities;
+
+    // Symbol table, keys view the names owned by the graph's vertices
+    unordered_map<string_view, EntityId> symbols;
+
+    // Shared scratch for the traversals below, indexed by vertex id
+    VisitMarker visited;
+    VisitMarker visitedBackward;
+    VisitMarker ancestorMark;
+    vector<int> ancestorDist;
+    vector<VertexNode<string> *> predScratch;
+    vector<EntityId> relatedScratch;
+    vector<VertexNode<string> *> forwardFrontier, backwardFrontier, frontierScratch;
+
+    // Optional coordinates per EntityId, the A* heuristic
+    vector<Point> positions;
+    vector<char> hasPosition;
+
+    // Optional reachability index and the graph generation it was built at;
+    // reachIdOf maps an EntityId to its dense id inside the index
+    ReachabilityIndex reachIndex;
+    vector<int> reachIdOf;
+    bool reachIndexEnabled;
+    bool reachIndexBuilt;
+    unsigned long long reachIndexGeneration;
+
+    // Optional cache of bfs, getRelatedEntities and findCommonAncestors answers
+    QueryCache queryCache;
+
+    // Optional components and topological order, updated as the graph changes
+    unique_ptr<DynamicTopology<string>> topology;
+
+    VertexNode<string> *findNode(string_view entity);
+    VertexNode<string> *requireNode(string_view entity);
+    VertexNode<string> *requireNode(EntityId id);
+    bool isReachable(VertexNode<string> *fromNode, VertexNode<string> *toNode);
+    void refreshReachabilityIndex();
+    string cachedText(const QueryCache::Key &key, const function<string()> &compute);
+    vector<string> cachedItems(const QueryCache::Key &key, const function<vector<string>()> &compute);
+    string cachedBFS(VertexNode<string> *start);
+    string commonAncestors(VertexNode<string> *node1, VertexNode<string> *node2);
+
+    void sortedPredecessors(VertexNode<string> *node, vector<VertexNode<string> *> &out);
+    void reverseLevels(VertexNode<string> *start,
+                       VisitMarker &mark,
+                       vector<VertexNode<string> *> &order,
+                       vector<int> &dist);
 
 public:
     KnowledgeGraph();
 
-    void addEntity(string entity);
-    void addRelation(string from, string to, float weight = 1.0f);
+    void addEntity(const string &entity);
+    void addRelation(const string &from, const string &to, float weight = 1.0f);
+    void addRelation(EntityId from, EntityId to, float weight = 1.0f);
+    void removeRelation(const string &from, const string &to);
+    // Drops the entity with all its relations; its EntityId is not reused
+    void removeEntity(const string &entity);
+
+    // How a repeated addRelation between the same pair is handled
+    void setRelationPolicy(EdgePolicy policy);
+
+    // Bulk loading. Repeats inside a batch are collapsed; names that already
+    // exist (or relation endpoints that do not) are reported together in one
+    // exception and leave the graph unchanged.
+    void addEntities(const vector<string> &names);
+    void addRelations(const vector<Relation> &relations);
+
+    // Streaming text loaders. Entity input has one name per line, relation
+    // input has "from<TAB>to[<TAB>weight]" lines (weight defaults to 1).
+    // Blank lines are skipped. Input is read in large chunks and tokenized
+    // in place; a bad line throws with its line number, keeping the lines
+    // before it. A path of "-" reads stdin. If report is given, the
+    // throughput summary is written to it.
+    LoadStats loadEntities(istream &in, ostream *report = nullptr);
+    LoadStats loadRelations(istream &in, ostream *report = nullptr);
+    LoadStats loadEntitiesFile(const string &path, ostream *report = nullptr);
+    LoadStats loadRelationsFile(const string &path, ostream *report = nullptr);
+
+    // Binary snapshot (see MappedKnowledgeGraph for the format). Loading
+    // appends the snapshot's entities and relations to this graph.
+    void saveSnapshot(const string &path);
+    void loadSnapshot(const string &path);
+
+    EntityId getEntityId(const string &entity);
+    const string &getEntityName(EntityId id);
 
     vector<string> getAllEntities();
-    vector<string> getNeighbors(string entity);
+    vector<string> getNeighbors(const string &entity);
+    vector<EntityId> getNeighbors(EntityId entity);
+
+    string bfs(const string &start);
+    string bfs(EntityId start);
+    string dfs(const string &start);
+    string dfs(EntityId start);
+
+    // Same orders as bfs/dfs without building strings: ids are written to
+    // out (its capacity is reused), or handed to visit until it returns
+    // false. formatEntities gives the string bfs/dfs would have returned.
+    vector<EntityId> bfsIds(const string &start);
+    vector<EntityId> dfsIds(const string &start);
+    void bfsIds(EntityId start, vector<EntityId> &out);
+    void dfsIds(EntityId start, vector<EntityId> &out);
+    void bfsVisit(EntityId start, const function<bool(EntityId)> &visit);
+    void dfsVisit(EntityId start, const function<bool(EntityId)> &visit);
+    string formatEntities(const vector<EntityId> &ids);
+
+    bool isReachable(const string &from, const string &to);
+    bool isReachable(EntityId from, EntityId to);
+
+    // For graphs that change rarely: while enabled, isReachable answers from
+    // a ReachabilityIndex. Any change to the graph makes it stale and the
+    // next query rebuilds it.
+    void enableReachabilityIndex(bool enabled = true);
+    bool isReachabilityIndexFresh();
 
-    string bfs(string start);
-    string dfs(string start);
+    // Strongly connected components and a topological order, computed on
+    // demand or, while tracking is enabled, kept up to date as relations
+    // change (see DynamicTopology). Tracking also lets isReachable answer
+    // from the order when it can. topologicalOrder lists the entities of a
+    // cycle together.
+    void enableTopologyTracking(bool enabled = true);
+    bool isAcyclic();
+    bool stronglyConnected(const string &entity1, const string &entity2);
+    vector<string> topologicalOrder();
 
-    bool isReachable(string from, string to);
+    // For skewed query traffic: keeps up to entries answers of bfs,
+    // getRelatedEntities(entity, depth) and findCommonAncestors, least
+    // recently used out first. Any change to the graph drops them all.
+    // 0 entries (the default) turns the cache off.
+    void setQueryCacheCapacity(size_t entries);
+    QueryCacheStats getQueryCacheStats() const;
+
+    // Multi-threaded variants for very wide frontiers
+    string bfsParallel(const string &start, const ParallelBFSOptions &options = ParallelBFSOptions());
+    bool isReachableParallel(const string &from, const string &to,
+                             const ParallelBFSOptions &options = ParallelBFSOptions());
+
+    // Batched queries, answered in submission order on up to threads
+    // workers of the graph's WorkerPool (0 = one per core). Reachability
+    // runs the single-query search (or the index, if enabled) per query.
+    // Related entities go 64 queries to one multi-source BFS in which every
+    // vertex keeps a bitmask of the queries that reached it, so a vertex
+    // reached by several is expanded once; results match
+    // getRelatedEntities' but are listed in EntityId order within each hop.
+    vector<bool> isReachableBatch(const vector<pair<string, string>> &queries, int threads = 0);
+    vector<vector<string>> getRelatedEntitiesBatch(const vector<pair<string, int>> &queries, int threads = 0);
     string toString();
+    void writeTo(ostream &out);
+
+    vector<string> getRelatedEntities(const string &entity, int depth = 2);
+    string findCommonAncestors(const string &entity1, const string &entity2);
+
+    // k-hop neighborhoods with caps or a weight budget, see KHopOptions.
+    // relatedIds fills reused buffers with EntityIds and, if asked, each
+    // one's hop count (or weighted distance).
+    vector<string> getRelatedEntities(const string &entity, const KHopOptions &options);
+    void relatedIds(EntityId start, const KHopOptions &options,
+                    vector<EntityId> &out, vector<double> *distances = nullptr);
+
+    // Cheapest paths by relation weight; PathResult::path holds EntityIds.
+    // shortestPathAStar steers by straight-line distance between entity
+    // positions, which is only exact if every relation weight is at least
+    // the distance it spans. Entities without a position estimate 0.
+    void setEntityPosition(const string &entity, const Point &position);
+    PathResult shortestPath(const string &from, const string &to);
+    PathResult shortestPathAStar(const string &from, const string &to);
+    PathResult shortestPathFromAny(const vector<string> &sources, const string &to);
 
-    vector<string> getRelatedEntities(string entity, int depth = 2);
-    string findCommonAncestors(string entity1, string entity2);
+    // Read-optimized snapshot for query-heavy workloads
+    CSRGraph<string> freeze();
 
     vector<string> getIncomingNeighbors(const string &target);
     void reverseBfsDistances(const string &start,
@@ -163,4 +1426,134 @@ public:
                             vector<int> &dist);
 };
 
+// =====================================
+// Class MappedKnowledgeGraph
+// =====================================
+// Read-only KnowledgeGraph served straight from a snapshot file written by
+// KnowledgeGraph::saveSnapshot. The file is memory-mapped, so opening it
+// costs no parsing and processes opening the same file share its pages.
+//
+// Snapshot format, version 1 (native byte order, sections 8-byte aligned):
+//   header        magic "KGSNAP01", version, byte-order tag, counts and the
+//                 file offset of every section below
+//   nameOffsets   uint64[n + 1], name i is names[nameOffsets[i] .. [i + 1])
+//   names         UTF-8 bytes of all entity names, back to back
+//   hashSlots     uint32[h], open-addressing FNV-1a table of id + 1 (0 = empty)
+//   outOffsets    int32[n + 1], outTargets int32[m], outWeights float[m]
+//   inOffsets     int32[n + 1], inSources int32[m]
+class MappedKnowledgeGraph
+{
+private:
+    const char *base;
+    size_t length;
+
+    const unsigned long long *nameOffsets;
+    const char *names;
+    const unsigned int *hashSlots;
+    unsigned long long hashMask;
+    CSRView csr;
+
+    void unmap();
+    int requireId(string_view entity);
+    string formatIds(const vector<int> &ids);
+
+public:
+    explicit MappedKnowledgeGraph(const string &path);
+    ~MappedKnowledgeGraph();
+
+    MappedKnowledgeGraph(const MappedKnowledgeGraph &) = delete;
+    MappedKnowledgeGraph &operator=(const MappedKnowledgeGraph &) = delete;
+
+    int size();
+    CSRView view() const { return csr; }
+
+    // -1 if the entity is not in the snapshot
+    EntityId findEntityId(string_view entity);
+    string_view getEntityName(EntityId id);
+
+    vector<string> getAllEntities();
+    vector<string> getNeighbors(const string &entity);
+    string bfs(const string &start);
+    string dfs(const string &start);
+    bool isReachable(const string &from, const string &to);
+    vector<string> getRelatedEntities(const string &entity, int depth = 2);
+    string findCommonAncestors(const string &entity1, const string &entity2);
+};
+
+// =====================================
+// Class ConcurrentKnowledgeGraph
+// =====================================
+// KnowledgeGraph for many reader threads and a few writers. Writers apply
+// changes to a private KnowledgeGraph under a mutex; publish() freezes it
+// into a new CSRGraph version and swaps a pointer to it in with one atomic
+// store. Readers take no lock: a query bumps a reader counter, loads the
+// pointer, copies the version's shared_ptr and drops the counter again,
+// then works on its copy to the end, so it sees either all of a published
+// batch or none of it. The publishing writer waits for both reader
+// counters to drain (a grace period) before deleting the old pointer; the
+// version itself is freed when the last query holding it lets go.
+//
+// Queries only see published changes. Every publish costs a full freeze,
+// O(V + E), however few changes it carries, so writers should batch:
+// apply() runs a group of changes under one lock and publishes them as one
+// version, and setAutoPublish(n) publishes once n single changes are
+// pending (setAutoPublish(1) pays the freeze on every mutation). Version
+// ids are dense, the same as freeze(), so snapshot() ids are not EntityIds
+// once entities have been removed.
+class ConcurrentKnowledgeGraph
+{
+private:
+    KnowledgeGraph graph;
+    mutex writeLock;
+    size_t pending;
+    size_t autoPublish;
+
+    // The published version, replaced (never modified) by publishLocked.
+    // Readers register in readers[readEpoch] while they copy it.
+    atomic<shared_ptr<CSRGraph<string>> *> current;
+    atomic<int> readEpoch;
+    mutable atomic<long> readers[2];
+    atomic<unsigned long long> versionNumber;
+
+    void publishLocked();
+    void waitForReaders();
+    void changed();
+    static int requireId(CSRGraph<string> &version, const string &entity);
+    static string formatIds(CSRGraph<string> &version, const vector<int> &ids);
+
+public:
+    ConcurrentKnowledgeGraph();
+    ~ConcurrentKnowledgeGraph();
+
+    ConcurrentKnowledgeGraph(const ConcurrentKnowledgeGraph &) = delete;
+    ConcurrentKnowledgeGraph &operator=(const ConcurrentKnowledgeGraph &) = delete;
+
+    // Writers. Errors are thrown right away, as in KnowledgeGraph.
+    void addEntity(const string &entity);
+    void addRelation(const string &from, const string &to, float weight = 1.0f);
+    void removeRelation(const string &from, const string &to);
+    void removeEntity(const string &entity);
+    void publish();
+    void setAutoPublish(size_t pendingChanges);
+    size_t pendingChanges();
+
+    // Runs changes on the writer's graph under the write lock and publishes
+    // the result as one version. If changes throws, whatever it applied
+    // stays pending for the next publish and the exception propagates.
+    void apply(const function<void(KnowledgeGraph &)> &changes);
+
+    // Readers, lock-free against the latest published version
+    shared_ptr<CSRGraph<string>> snapshot() const;
+    unsigned long long version() const;
+
+    int size() const;
+    vector<string> getAllEntities() const;
+    vector<string> getNeighbors(const string &entity) const;
+    string bfs(const string &start) const;
+    string dfs(const string &start) const;
+    bool isReachable(const string &from, const string &to) const;
+    vector<string> getRelatedEntities(const string &entity, int depth = 2) const;
+    string findCommonAncestors(const string &entity1, const string &entity2) const;
+};
+
 #endif // KNOWLEDGEGRAPH_H
\ No newline at end of file
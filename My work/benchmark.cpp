@@ -0,0 +1,629 @@
+// Google Benchmark suite for DGraphModel and KnowledgeGraph.
+//
+// Build:  g++ -std=c++17 -O2 -o benchmark benchmark.cpp KnowledgeGraph.cpp -lbenchmark -lpthread
+// Run:    ./benchmark [--benchmark_filter=BFS/grid]
+//
+// Every operation runs on synthetic graphs of each shape (random, power-law,
+// chain, grid, DAG) from 1K edges up to KG_BENCH_MAX_EDGES (default 1M, set
+// it to 10000000 for the full range). Besides Google Benchmark's ns/op, each
+// case reports edges/s or items/s. Cases on a shared fixture report
+// fixture_MB, the resident memory its KnowledgeGraph added when it was
+// built (Linux only, from /proc/self/statm); BM_Build reports graph_MB,
+// measured the same way around its first build.
+
+#include "KnowledgeGraph.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// =============================================================================
+// Synthetic graph generators
+// =============================================================================
+
+enum Shape
+{
+    RANDOM,
+    POWER_LAW,
+    CHAIN,
+    GRID,
+    DAG
+};
+
+static const char *SHAPE_NAMES[] = {"random", "powerlaw", "chain", "grid", "dag"};
+
+struct EdgeList
+{
+    int vertices;
+    vector<pair<int, int>> edges;
+};
+
+static EdgeList makeGraph(Shape shape, long long edgeCount, unsigned seed = 42)
+{
+    EdgeList g;
+    mt19937 rng(seed);
+
+    switch (shape)
+    {
+    case RANDOM:
+    {
+        // Average out-degree 4
+        g.vertices = max(2LL, edgeCount / 4);
+        for (long long i = 0; i < edgeCount; ++i)
+            g.edges.push_back(make_pair(rng() % g.vertices, rng() % g.vertices));
+        break;
+    }
+    case POWER_LAW:
+    {
+        // Preferential attachment: targets drawn from the endpoint history,
+        // so a vertex is picked proportionally to its degree
+        g.vertices = max(2LL, edgeCount / 4);
+        vector<int> endpoints;
+        endpoints.reserve(2 * edgeCount);
+        endpoints.push_back(0);
+        int next = 1;
+        for (long long i = 0; i < edgeCount; ++i)
+        {
+            int from = (next < g.vertices && i % 4 == 0) ? next++ : rng() % next;
+            int to = endpoints[rng() % endpoints.size()];
+            g.edges.push_back(make_pair(from, to));
+            endpoints.push_back(from);
+            endpoints.push_back(to);
+        }
+        break;
+    }
+    case CHAIN:
+    {
+        g.vertices = edgeCount + 1;
+        for (long long i = 0; i < edgeCount; ++i)
+            g.edges.push_back(make_pair(i, i + 1));
+        break;
+    }
+    case GRID:
+    {
+        // side x side grid with right and down edges
+        int side = max(2, (int)sqrt(edgeCount / 2.0));
+        g.vertices = side * side;
+        for (int r = 0; r < side; ++r)
+        {
+            for (int c = 0; c < side; ++c)
+            {
+                if (c + 1 < side)
+                    g.edges.push_back(make_pair(r * side + c, r * side + c + 1));
+                if (r + 1 < side)
+                    g.edges.push_back(make_pair(r * side + c, (r + 1) * side + c));
+            }
+        }
+        break;
+    }
+    case DAG:
+    {
+        // Edges only go from lower to higher ids
+        g.vertices = max(2LL, edgeCount / 4);
+        for (long long i = 0; i < edgeCount; ++i)
+        {
+            int a = rng() % g.vertices, b = rng() % g.vertices;
+            if (a == b)
+                b = (b + 1) % g.vertices;
+            g.edges.push_back(make_pair(min(a, b), max(a, b)));
+        }
+        break;
+    }
+    }
+    return g;
+}
+
+static string entityName(int v)
+{
+    return "e" + to_string(v);
+}
+
+static void buildKnowledgeGraph(KnowledgeGraph &kg, const EdgeList &g)
+{
+    for (int v = 0; v < g.vertices; ++v)
+        kg.addEntity(entityName(v));
+    for (const pair<int, int> &e : g.edges)
+        kg.addRelation((EntityId)e.first, (EntityId)e.second, 1.0f);
+}
+
+// Resident set size of the process right now, or -1 where it cannot be
+// read. Unlike the peak from getrusage it also goes down, so the
+// difference around a build is what that build kept. Free heap pages are
+// handed back first; otherwise a build that reuses them shows up as 0.
+static long long currentRSS()
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+#ifndef _WIN32
+    ifstream statm("/proc/self/statm");
+    long long pages = 0, resident = 0;
+    if (statm >> pages >> resident)
+        return resident * sysconf(_SC_PAGESIZE);
+#endif
+    return -1;
+}
+
+static double rssDeltaMB(long long before)
+{
+    long long after = currentRSS();
+    if (before < 0 || after < 0)
+        return -1;
+    return max(0LL, after - before) / (1024.0 * 1024.0);
+}
+
+// Built graphs are shared between benchmarks of the same shape and size
+struct Fixture
+{
+    EdgeList edges;
+    KnowledgeGraph kg;
+    vector<string> names;
+    double graphMB; // resident memory added by building kg, -1 if unknown
+};
+
+static Fixture &fixture(Shape shape, long long edgeCount)
+{
+    static map<pair<int, long long>, unique_ptr<Fixture>> cache;
+    unique_ptr<Fixture> &slot = cache[make_pair((int)shape, edgeCount)];
+    if (!slot)
+    {
+        slot.reset(new Fixture());
+        slot->edges = makeGraph(shape, edgeCount);
+        long long before = currentRSS();
+        buildKnowledgeGraph(slot->kg, slot->edges);
+        slot->graphMB = rssDeltaMB(before);
+        for (int v = 0; v < slot->edges.vertices; ++v)
+            slot->names.push_back(entityName(v));
+    }
+    return *slot;
+}
+
+static void reportCommon(benchmark::State &state, long long edgesPerIteration, const Fixture *f = nullptr)
+{
+    if (f && f->graphMB >= 0)
+        state.counters["fixture_MB"] = f->graphMB;
+    if (edgesPerIteration > 0)
+        state.counters["edges/s"] = benchmark::Counter(
+            (double)edgesPerIteration * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+// =============================================================================
+// Mutations
+// =============================================================================
+
+static void BM_Build(benchmark::State &state, Shape shape)
+{
+    EdgeList g = makeGraph(shape, state.range(0));
+    double graphMB = -1;
+    for (auto _ : state)
+    {
+        // Measured once, outside of the later iterations' timings
+        long long before = graphMB < 0 ? currentRSS() : -1;
+        KnowledgeGraph kg;
+        buildKnowledgeGraph(kg, g);
+        benchmark::DoNotOptimize(kg);
+        if (before >= 0)
+            graphMB = rssDeltaMB(before);
+    }
+    if (graphMB >= 0)
+        state.counters["graph_MB"] = graphMB;
+    reportCommon(state, g.edges.size());
+}
+
+static void BM_AddEntity(benchmark::State &state, Shape shape)
+{
+    EdgeList g = makeGraph(shape, state.range(0));
+    vector<string> names;
+    for (int v = 0; v < g.vertices; ++v)
+        names.push_back(entityName(v));
+
+    for (auto _ : state)
+    {
+        KnowledgeGraph kg;
+        for (const string &name : names)
+            kg.addEntity(name);
+    }
+    state.SetItemsProcessed(state.iterations() * names.size());
+    reportCommon(state, 0);
+}
+
+static void BM_Connect(benchmark::State &state, Shape shape)
+{
+    EdgeList g = makeGraph(shape, state.range(0));
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        DGraphModel<int> model;
+        for (int v = 0; v < g.vertices; ++v)
+            model.add(v);
+        state.ResumeTiming();
+
+        for (const pair<int, int> &e : g.edges)
+            model.connect(e.first, e.second, 1.0f);
+    }
+    state.SetItemsProcessed(state.iterations() * g.edges.size());
+    reportCommon(state, g.edges.size());
+}
+
+// Connect with components and topological order kept up to date
+static void BM_ConnectTracked(benchmark::State &state, Shape shape)
+{
+    EdgeList g = makeGraph(shape, state.range(0));
+    long long rebuilds = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        DGraphModel<int> model;
+        for (int v = 0; v < g.vertices; ++v)
+            model.add(v);
+        DynamicTopology<int> topology(model);
+        state.ResumeTiming();
+
+        for (const pair<int, int> &e : g.edges)
+            model.connect(e.first, e.second, 1.0f);
+        benchmark::DoNotOptimize(topology.componentCount());
+        rebuilds += topology.rebuilds() - 1;
+    }
+    state.counters["rebuilds"] = rebuilds;
+    state.SetItemsProcessed(state.iterations() * g.edges.size());
+    reportCommon(state, g.edges.size());
+}
+
+static void BM_Disconnect(benchmark::State &state, Shape shape)
+{
+    EdgeList g = makeGraph(shape, state.range(0));
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        DGraphModel<int> model;
+        for (int v = 0; v < g.vertices; ++v)
+            model.add(v);
+        for (const pair<int, int> &e : g.edges)
+            model.connect(e.first, e.second, 1.0f);
+        state.ResumeTiming();
+
+        for (const pair<int, int> &e : g.edges)
+            model.disconnect(e.first, e.second);
+    }
+    state.SetItemsProcessed(state.iterations() * g.edges.size());
+    reportCommon(state, g.edges.size());
+}
+
+static void BM_RemoveVertex(benchmark::State &state, Shape shape)
+{
+    EdgeList g = makeGraph(shape, state.range(0));
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        DGraphModel<int> model;
+        for (int v = 0; v < g.vertices; ++v)
+            model.add(v);
+        for (const pair<int, int> &e : g.edges)
+            model.connect(e.first, e.second, 1.0f);
+        state.ResumeTiming();
+
+        for (int v = 0; v < g.vertices; ++v)
+            model.remove(v);
+    }
+    state.SetItemsProcessed(state.iterations() * g.vertices);
+    reportCommon(state, g.edges.size());
+}
+
+// =============================================================================
+// Queries
+// =============================================================================
+
+static void BM_Contains(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    DGraphModel<string> model;
+    for (const string &name : f.names)
+        model.add(name);
+
+    mt19937 rng(1);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(model.contains(f.names[rng() % f.names.size()]));
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+static void BM_BFS(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(f.kg.bfs(f.names[0]));
+    reportCommon(state, f.edges.edges.size(), &f);
+}
+
+static void BM_BFSIds(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    vector<EntityId> ids;
+    for (auto _ : state)
+    {
+        f.kg.bfsIds(0, ids);
+        benchmark::DoNotOptimize(ids.data());
+    }
+    reportCommon(state, f.edges.edges.size(), &f);
+}
+
+static void BM_BFSParallel(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    ParallelBFSOptions options;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(f.kg.bfsParallel(f.names[0], options));
+    reportCommon(state, f.edges.edges.size(), &f);
+}
+
+static void BM_DFS(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(f.kg.dfs(f.names[0]));
+    reportCommon(state, f.edges.edges.size(), &f);
+}
+
+static void BM_IsReachable(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    mt19937 rng(2);
+    for (auto _ : state)
+    {
+        const string &a = f.names[rng() % f.names.size()];
+        const string &b = f.names[rng() % f.names.size()];
+        benchmark::DoNotOptimize(f.kg.isReachable(a, b));
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+static void BM_IsReachableIndexed(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    f.kg.enableReachabilityIndex();
+    f.kg.isReachable(f.names[0], f.names[1]);
+
+    mt19937 rng(2);
+    for (auto _ : state)
+    {
+        const string &a = f.names[rng() % f.names.size()];
+        const string &b = f.names[rng() % f.names.size()];
+        benchmark::DoNotOptimize(f.kg.isReachable(a, b));
+    }
+    f.kg.enableReachabilityIndex(false);
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+static void BM_IsReachableBatch(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    mt19937 rng(2);
+    vector<pair<string, string>> queries;
+    for (int i = 0; i < 1024; ++i)
+        queries.push_back(make_pair(f.names[rng() % f.names.size()], f.names[rng() % f.names.size()]));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(f.kg.isReachableBatch(queries));
+    state.SetItemsProcessed(state.iterations() * queries.size());
+    reportCommon(state, 0, &f);
+}
+
+// Reads against the published version while a writer keeps adding
+// relations and publishing every 1000 of them
+static void BM_ConcurrentReads(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    ConcurrentKnowledgeGraph ckg;
+    for (const string &name : f.names)
+        ckg.addEntity(name);
+    for (const pair<int, int> &e : f.edges.edges)
+        ckg.addRelation(f.names[e.first], f.names[e.second]);
+    ckg.publish();
+    ckg.setAutoPublish(1000);
+
+    atomic<bool> done(false);
+    thread writer([&]()
+                  {
+        mt19937 rng(3);
+        while (!done.load(memory_order_relaxed))
+            ckg.addRelation(f.names[rng() % f.names.size()], f.names[rng() % f.names.size()]); });
+
+    mt19937 rng(2);
+    for (auto _ : state)
+    {
+        const string &a = f.names[rng() % f.names.size()];
+        const string &b = f.names[rng() % f.names.size()];
+        benchmark::DoNotOptimize(ckg.isReachable(a, b));
+    }
+    done.store(true);
+    writer.join();
+    state.counters["versions"] = ckg.version();
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+static void BM_ShortestPath(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    mt19937 rng(5);
+    for (auto _ : state)
+    {
+        const string &a = f.names[rng() % f.names.size()];
+        const string &b = f.names[rng() % f.names.size()];
+        benchmark::DoNotOptimize(f.kg.shortestPath(a, b));
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+static void BM_RelatedEntities(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    mt19937 rng(3);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(f.kg.getRelatedEntities(f.names[rng() % f.names.size()], 2));
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+// Three hops with each hop capped, the shape a ranking query would use
+static void BM_KHopCapped(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    mt19937 rng(3);
+    KHopOptions options(3);
+    options.perHopLimit = 64;
+    vector<EntityId> ids;
+    for (auto _ : state)
+    {
+        f.kg.relatedIds(f.kg.getEntityId(f.names[rng() % f.names.size()]), options, ids);
+        benchmark::DoNotOptimize(ids.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+static void BM_RelatedEntitiesBatch(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    mt19937 rng(3);
+    vector<pair<string, int>> queries;
+    for (int i = 0; i < 1024; ++i)
+        queries.push_back(make_pair(f.names[rng() % f.names.size()], 2));
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(f.kg.getRelatedEntitiesBatch(queries));
+    state.SetItemsProcessed(state.iterations() * queries.size());
+    reportCommon(state, 0, &f);
+}
+
+// Skewed traffic: most queries hit a few hot entities
+static void BM_RelatedEntitiesCached(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    f.kg.setQueryCacheCapacity(1024);
+    mt19937 rng(3);
+    size_t hot = min(f.names.size(), (size_t)256);
+    for (auto _ : state)
+    {
+        size_t i = rng() % 8 == 0 ? rng() % f.names.size() : rng() % hot;
+        benchmark::DoNotOptimize(f.kg.getRelatedEntities(f.names[i], 2));
+    }
+    QueryCacheStats stats = f.kg.getQueryCacheStats();
+    state.counters["hit_rate"] = stats.hitRate();
+    f.kg.setQueryCacheCapacity(0);
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+static void BM_CommonAncestors(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    mt19937 rng(4);
+    for (auto _ : state)
+    {
+        const string &a = f.names[rng() % f.names.size()];
+        const string &b = f.names[rng() % f.names.size()];
+        benchmark::DoNotOptimize(f.kg.findCommonAncestors(a, b));
+    }
+    state.SetItemsProcessed(state.iterations());
+    reportCommon(state, 0, &f);
+}
+
+static void BM_ToString(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(f.kg.toString());
+    reportCommon(state, f.edges.edges.size(), &f);
+}
+
+// Discards everything written to it
+class NullBuffer : public streambuf
+{
+protected:
+    streamsize xsputn(const char *, streamsize n) override { return n; }
+    int overflow(int c) override { return c; }
+};
+
+static void BM_WriteTo(benchmark::State &state, Shape shape)
+{
+    Fixture &f = fixture(shape, state.range(0));
+    NullBuffer null;
+    ostream out(&null);
+    for (auto _ : state)
+        f.kg.writeTo(out);
+    reportCommon(state, f.edges.edges.size(), &f);
+}
+
+// =============================================================================
+// Registration
+// =============================================================================
+
+typedef void (*BenchFn)(benchmark::State &, Shape);
+
+int main(int argc, char **argv)
+{
+    long long maxEdges = 1000000;
+    if (const char *env = getenv("KG_BENCH_MAX_EDGES"))
+        maxEdges = atoll(env);
+
+    const pair<const char *, BenchFn> cases[] = {
+        {"Build", BM_Build},
+        {"AddEntity", BM_AddEntity},
+        {"Connect", BM_Connect},
+        {"ConnectTracked", BM_ConnectTracked},
+        {"Disconnect", BM_Disconnect},
+        {"RemoveVertex", BM_RemoveVertex},
+        {"Contains", BM_Contains},
+        {"BFS", BM_BFS},
+        {"BFSIds", BM_BFSIds},
+        {"BFSParallel", BM_BFSParallel},
+        {"DFS", BM_DFS},
+        {"IsReachable", BM_IsReachable},
+        {"IsReachableIndexed", BM_IsReachableIndexed},
+        {"IsReachableBatch", BM_IsReachableBatch},
+        {"ConcurrentReads", BM_ConcurrentReads},
+        {"ShortestPath", BM_ShortestPath},
+        {"RelatedEntities", BM_RelatedEntities},
+        {"RelatedEntitiesBatch", BM_RelatedEntitiesBatch},
+        {"KHopCapped", BM_KHopCapped},
+        {"RelatedEntitiesCached", BM_RelatedEntitiesCached},
+        {"CommonAncestors", BM_CommonAncestors},
+        {"ToString", BM_ToString},
+        {"WriteTo", BM_WriteTo},
+    };
+
+    for (const pair<const char *, BenchFn> &c : cases)
+    {
+        for (int shape = RANDOM; shape <= DAG; ++shape)
+        {
+            string name = string(c.first) + "/" + SHAPE_NAMES[shape];
+            benchmark::internal::Benchmark *b =
+                benchmark::RegisterBenchmark(name.c_str(), c.second, (Shape)shape);
+            for (long long edges = 1000; edges <= maxEdges; edges *= 10)
+                b->Arg(edges);
+            b->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
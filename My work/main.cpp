@@ -287,6 +287,634 @@ void tc_KG_008_basic_like_sample()
     cout << "\n";
 }
 
+// Equal ignoring case, and hashed by length so every three-letter name
+// below lands on the same hash: lookups in the snapshot must walk the
+// colliding entries and settle them with the custom equality
+static bool sameIgnoringCase(string &a, string &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return false;
+    }
+    return true;
+}
+
+static string nameOf(string &name)
+{
+    return name;
+}
+
+static size_t lengthHash(string &name)
+{
+    return name.size();
+}
+
+void tc_KG_009_frozen_snapshot()
+{
+    cout << "tc_KG_009_frozen_snapshot\n";
+    DGraphModel<string> model(sameIgnoringCase, nameOf, lengthHash);
+
+    // ant -> bee -> cat, ant -> dog -> cat; emu has no edges
+    model.add("ant");
+    model.add("bee");
+    model.add("cat");
+    model.add("dog");
+    model.add("emu");
+    model.connect("ant", "bee", 1);
+    model.connect("ant", "dog", 1);
+    model.connect("bee", "cat", 1);
+    model.connect("dog", "cat", 1);
+
+    CSRGraph<string> frozen = model.freeze();
+
+    // later changes must not leak into the snapshot, even ones sharing
+    // the hash of every indexed name
+    model.add("elk");
+    model.connect("emu", "elk", 1);
+
+    string probe = "DOG";
+    cout << "indexOf(DOG) = " << frozen.vertexAt(frozen.indexOf(probe)) << " (expect dog)\n";
+    probe = "fox";
+    cout << "indexOf(fox) = " << frozen.indexOf(probe) << " (expect -1)\n";
+
+    cout << "BFS(ANT) = " << frozen.BFS("ANT") << " (expect [ant, bee, dog, cat])\n";
+    cout << "DFS(Ant) = " << frozen.DFS("Ant") << " (expect [ant, bee, cat, dog])\n";
+    cout << "isReachable(ant,CAT) = " << (frozen.isReachable("ant", "CAT") ? "true" : "false") << " (expect true)\n";
+    cout << "isReachable(EMU,ant) = " << (frozen.isReachable("EMU", "ant") ? "true" : "false") << " (expect false)\n";
+
+    cout << "Related(ANT,1) = ";
+    printVec(frozen.getRelatedEntities("ANT", 1));
+    cout << " (expect [bee, dog])\n";
+
+    cout << "findCommonAncestors(Bee,DOG) = " << frozen.findCommonAncestors("Bee", "DOG") << " (expect ant)\n";
+
+    try
+    {
+        frozen.BFS("ELK");
+        cout << "[FAIL] expected exception for entity added after freeze\n";
+    }
+    catch (...)
+    {
+        cout << "[OK] BFS(ELK) on snapshot throws exception\n";
+    }
+
+    cout << "\n";
+}
+
+void tc_KG_010_dfs_long_chain()
+{
+    cout << "tc_KG_010_dfs_long_chain\n";
+    KnowledgeGraph kg;
+
+    // C0 -> C1 -> ... -> C199999, deep enough to overflow a recursive DFS
+    const int n = 200000;
+    for (int i = 0; i < n; ++i)
+        kg.addEntity("C" + to_string(i));
+    for (int i = 0; i + 1 < n; ++i)
+        kg.addRelation("C" + to_string(i), "C" + to_string(i + 1), 1);
+
+    string result = kg.dfs("C0");
+    bool ok = result.compare(0, 8, "[C0, C1,") == 0 &&
+              result.compare(result.size() - 10, 10, ", C199999]") == 0;
+    cout << "DFS(C0) ends at C199999: " << (ok ? "true" : "false") << " (expect true)\n";
+
+    cout << "\n";
+}
+
+void tc_KG_011_entity_ids()
+{
+    cout << "tc_KG_011_entity_ids\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+
+    EntityId a = kg.getEntityId("A");
+    EntityId b = kg.getEntityId("B");
+    EntityId c = kg.getEntityId("C");
+    cout << "ids = " << a << ", " << b << ", " << c << " (expect 0, 1, 2)\n";
+    cout << "name(1) = " << kg.getEntityName(b) << " (expect B)\n";
+
+    kg.addRelation(a, b, 1);
+    kg.addRelation("B", "C", 1);
+
+    vector<EntityId> nb = kg.getNeighbors(a);
+    cout << "Neighbors(A) = " << nb.size() << " id(s), first " << nb[0] << " (expect 1 id(s), first 1)\n";
+    cout << "BFS(A) = " << kg.bfs(a) << " (expect [A, B, C])\n";
+    cout << "isReachable(A,C) = " << (kg.isReachable(a, c) ? "true" : "false") << " (expect true)\n";
+
+    try
+    {
+        kg.bfs((EntityId)42);
+        cout << "[FAIL] expected exception for unknown id\n";
+    }
+    catch (...)
+    {
+        cout << "[OK] bfs(42) throws exception\n";
+    }
+
+    cout << "\n";
+}
+
+void tc_KG_012_bulk_load()
+{
+    cout << "tc_KG_012_bulk_load\n";
+    KnowledgeGraph kg;
+
+    kg.addEntities({"A", "B", "C", "B", "D"});
+    vector<string> ents = kg.getAllEntities();
+    cout << "Entities = ";
+    printVec(ents);
+    cout << " (expect [A, B, C, D])\n";
+
+    kg.addRelations({Relation("A", "B", 1), Relation("A", "C", 2), Relation("C", "D", 3)});
+    cout << "BFS(A) = " << kg.bfs("A") << " (expect [A, B, C, D])\n";
+
+    try
+    {
+        kg.addRelations({Relation("A", "D", 1), Relation("X", "Y", 1), Relation("B", "X", 1)});
+        cout << "[FAIL] expected exception for unknown endpoints\n";
+    }
+    catch (exception &e)
+    {
+        cout << "[OK] " << e.what() << " (expect X, Y)\n";
+    }
+    cout << "Neighbors(A) size = " << kg.getNeighbors("A").size() << " (expect 2, batch rejected)\n";
+
+    try
+    {
+        kg.addEntities({"E", "A"});
+        cout << "[FAIL] expected exception for existing entity\n";
+    }
+    catch (exception &e)
+    {
+        cout << "[OK] " << e.what() << " (expect A)\n";
+    }
+    cout << "Entities size = " << kg.getAllEntities().size() << " (expect 4)\n";
+
+    cout << "\n";
+}
+
+void tc_KG_013_stream_load()
+{
+    cout << "tc_KG_013_stream_load\n";
+    KnowledgeGraph kg;
+
+    stringstream entities("A\nB\r\n\nC\n");
+    stringstream relations("A\tB\t2.5\nB\tC\n");
+
+    LoadStats e = kg.loadEntities(entities);
+    LoadStats r = kg.loadRelations(relations);
+    cout << "Loaded " << e.entities << " entities, " << r.relations << " relations (expect 3, 2)\n";
+    cout << "BFS(A) = " << kg.bfs("A") << " (expect [A, B, C])\n";
+
+    stringstream bad("A\tC\nA\tX\t1\n");
+    try
+    {
+        kg.loadRelations(bad);
+        cout << "[FAIL] expected exception for unknown entity\n";
+    }
+    catch (exception &ex)
+    {
+        cout << "[OK] " << ex.what() << " (expect X on line 2)\n";
+    }
+
+    cout << "\n";
+}
+
+void tc_KG_014_snapshot_roundtrip()
+{
+    cout << "tc_KG_014_snapshot_roundtrip\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addRelation("A", "B", 1.5f);
+    kg.addRelation("B", "C", 2.0f);
+
+    const string path = "tc_KG_014.kgsnap";
+    kg.saveSnapshot(path);
+
+    {
+        MappedKnowledgeGraph mapped(path);
+        cout << "Mapped BFS(A) = " << mapped.bfs("A") << " (expect [A, B, C])\n";
+        cout << "Mapped isReachable(C,A) = " << (mapped.isReachable("C", "A") ? "true" : "false") << " (expect false)\n";
+    }
+
+    KnowledgeGraph restored;
+    restored.loadSnapshot(path);
+    cout << "Restored DFS(A) = " << restored.dfs("A") << " (expect [A, B, C])\n";
+    cout << "Restored Neighbors(B) = ";
+    printVec(restored.getNeighbors("B"));
+    cout << " (expect [C])\n";
+
+    remove(path.c_str());
+    cout << "\n";
+}
+
+void tc_KG_015_parallel_bfs()
+{
+    cout << "tc_KG_015_parallel_bfs\n";
+    KnowledgeGraph kg;
+
+    // Binary tree on 2000 entities, wide enough for parallel levels
+    const int n = 2000;
+    for (int i = 0; i < n; ++i)
+        kg.addEntity("N" + to_string(i));
+    for (int i = 1; i < n; ++i)
+        kg.addRelation("N" + to_string((i - 1) / 2), "N" + to_string(i), 1.0f);
+
+    ParallelBFSOptions options(4, true);
+    options.minParallelWork = 64;
+    bool same = kg.bfsParallel("N0", options) == kg.bfs("N0");
+    cout << "Deterministic parallel BFS == BFS: " << (same ? "true" : "false") << " (expect true)\n";
+    cout << "isReachableParallel(N0,N1999) = " << (kg.isReachableParallel("N0", "N1999", options) ? "true" : "false") << " (expect true)\n";
+    cout << "isReachableParallel(N1,N2) = " << (kg.isReachableParallel("N1", "N2", options) ? "true" : "false") << " (expect false)\n";
+    cout << "\n";
+}
+
+void tc_KG_016_bidirectional_reachability()
+{
+    cout << "tc_KG_016_bidirectional_reachability\n";
+    KnowledgeGraph kg;
+
+    // Long chain C0 -> ... -> C999 with a wide fan-in F* -> C999
+    for (int i = 0; i < 1000; ++i)
+        kg.addEntity("C" + to_string(i));
+    for (int i = 1; i < 1000; ++i)
+        kg.addRelation("C" + to_string(i - 1), "C" + to_string(i), 1.0f);
+    for (int i = 0; i < 50; ++i)
+    {
+        kg.addEntity("F" + to_string(i));
+        kg.addRelation("F" + to_string(i), "C999", 1.0f);
+    }
+
+    cout << "isReachable(C0,C999) = " << (kg.isReachable("C0", "C999") ? "true" : "false") << " (expect true)\n";
+    cout << "isReachable(F7,C999) = " << (kg.isReachable("F7", "C999") ? "true" : "false") << " (expect true)\n";
+    cout << "isReachable(C999,C0) = " << (kg.isReachable("C999", "C0") ? "true" : "false") << " (expect false)\n";
+    cout << "isReachable(F7,F8) = " << (kg.isReachable("F7", "F8") ? "true" : "false") << " (expect false)\n";
+    cout << "isReachable(C5,C5) = " << (kg.isReachable("C5", "C5") ? "true" : "false") << " (expect true)\n";
+    cout << "\n";
+}
+
+void tc_KG_017_reachability_index()
+{
+    cout << "tc_KG_017_reachability_index\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addEntity("D");
+    kg.addRelation("A", "B", 1.0f);
+    kg.addRelation("B", "A", 1.0f);
+    kg.addRelation("B", "C", 1.0f);
+
+    kg.enableReachabilityIndex();
+    cout << "isReachable(A,C) = " << (kg.isReachable("A", "C") ? "true" : "false") << " (expect true)\n";
+    cout << "isReachable(C,A) = " << (kg.isReachable("C", "A") ? "true" : "false") << " (expect false)\n";
+    cout << "Index fresh = " << (kg.isReachabilityIndexFresh() ? "true" : "false") << " (expect true)\n";
+
+    kg.addRelation("C", "D", 1.0f);
+    cout << "Index fresh after addRelation = " << (kg.isReachabilityIndexFresh() ? "true" : "false") << " (expect false)\n";
+    cout << "isReachable(A,D) = " << (kg.isReachable("A", "D") ? "true" : "false") << " (expect true)\n";
+
+    kg.removeRelation("B", "C");
+    cout << "isReachable(A,D) after removeRelation = " << (kg.isReachable("A", "D") ? "true" : "false") << " (expect false)\n";
+    cout << "\n";
+}
+
+void tc_KG_018_shortest_path()
+{
+    cout << "tc_KG_018_shortest_path\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addEntity("D");
+    kg.setEntityPosition("A", Point(0, 0));
+    kg.setEntityPosition("B", Point(1, 0));
+    kg.setEntityPosition("C", Point(0, 1));
+    kg.setEntityPosition("D", Point(1, 1));
+    kg.addRelation("A", "B", 1.0f);
+    kg.addRelation("B", "D", 1.0f);
+    kg.addRelation("A", "C", 1.0f);
+    kg.addRelation("C", "D", 5.0f);
+    kg.addRelation("A", "D", 3.0f);
+
+    PathResult path = kg.shortestPath("A", "D");
+    cout << "shortestPath(A,D) cost = " << path.cost << " via ";
+    for (int id : path.path)
+        cout << kg.getEntityName(id);
+    cout << " (expect 2 via ABD)\n";
+
+    PathResult astar = kg.shortestPathAStar("A", "D");
+    cout << "shortestPathAStar(A,D) cost = " << astar.cost << " (expect 2)\n";
+
+    PathResult multi = kg.shortestPathFromAny(vector<string>{"C", "B"}, "D");
+    cout << "shortestPathFromAny({C,B},D) starts at " << kg.getEntityName(multi.path[0]) << " (expect B)\n";
+
+    cout << "shortestPath(D,A) found = " << (kg.shortestPath("D", "A").found ? "true" : "false") << " (expect false)\n";
+    cout << "\n";
+}
+
+void tc_KG_019_traversal_ids()
+{
+    cout << "tc_KG_019_traversal_ids\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addEntity("D");
+    kg.addRelation("A", "B", 1.0f);
+    kg.addRelation("A", "C", 1.0f);
+    kg.addRelation("B", "D", 1.0f);
+
+    vector<EntityId> ids = kg.bfsIds("A");
+    cout << "formatEntities(bfsIds(A)) = " << kg.formatEntities(ids) << " (expect [A, B, C, D])\n";
+
+    kg.dfsIds(kg.getEntityId("A"), ids);
+    cout << "formatEntities(dfsIds(A)) = " << kg.formatEntities(ids) << " (expect [A, B, D, C])\n";
+
+    // Stop at the first entity past the start
+    vector<string> seen;
+    kg.bfsVisit(kg.getEntityId("A"), [&](EntityId id)
+                {
+        seen.push_back(kg.getEntityName(id));
+        return seen.size() < 2; });
+    cout << "bfsVisit(A) stopping after 2 = ";
+    printVec(seen);
+    cout << " (expect [A, B])\n";
+    cout << "\n";
+}
+
+void tc_KG_020_stream_dump()
+{
+    cout << "tc_KG_020_stream_dump\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addRelation("A", "B", 11.2f);
+    kg.addRelation("B", "A", 0.5f);
+
+    stringstream ss;
+    kg.writeTo(ss);
+    cout << "writeTo = " << ss.str() << "\n";
+    cout << "(expect [(A, 1, 1, [(A, B, 11.200000), (B, A, 0.500000)]), (B, 1, 1, [(A, B, 11.200000), (B, A, 0.500000)])])\n";
+    cout << "writeTo == toString: " << (ss.str() == kg.toString() ? "true" : "false") << " (expect true)\n";
+    cout << "\n";
+}
+
+void tc_KG_021_relation_policy()
+{
+    cout << "tc_KG_021_relation_policy\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addRelation("A", "B", 1.0f);
+    kg.addRelation("A", "B", 2.0f);
+    cout << "Default keeps multi-edges: Neighbors(A) = ";
+    printVec(kg.getNeighbors("A"));
+    cout << " (expect [B, B])\n";
+
+    kg.removeRelation("A", "B");
+    kg.setRelationPolicy(OVERWRITE_WEIGHT);
+    kg.addRelation("A", "B", 5.0f);
+    cout << "Overwrite: " << kg.toString() << "\n";
+    cout << "(expect [(A, 0, 1, [(A, B, 5.000000)]), (B, 1, 0, [(A, B, 5.000000)])])\n";
+
+    kg.setRelationPolicy(REJECT_DUPLICATES);
+    try
+    {
+        kg.addRelation("A", "B", 7.0f);
+        cout << "Reject: no exception (expect DuplicateEdgeException)\n";
+    }
+    catch (const DuplicateEdgeException &e)
+    {
+        cout << "Reject: " << e.what() << " (expect Edge already exists!)\n";
+    }
+    cout << "\n";
+}
+
+void tc_KG_022_remove_entity()
+{
+    cout << "tc_KG_022_remove_entity\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addRelation("A", "B");
+    kg.addRelation("B", "C");
+    kg.addRelation("A", "C");
+    kg.addRelation("C", "A");
+    EntityId c = kg.getEntityId("C");
+
+    kg.removeEntity("B");
+    cout << "After removing B: " << kg.toString() << "\n";
+    cout << "(expect [(A, 1, 1, [(A, C, 1.000000), (C, A, 1.000000)]), (C, 1, 1, [(A, C, 1.000000), (C, A, 1.000000)])])\n";
+    cout << "Entities: ";
+    printVec(kg.getAllEntities());
+    cout << " (expect [A, C])\n";
+    cout << "C keeps its id: " << (kg.getEntityId("C") == c ? "yes" : "no") << " (expect yes)\n";
+
+    try
+    {
+        kg.removeEntity("B");
+        cout << "Remove twice: no exception (expect EntityNotFoundException)\n";
+    }
+    catch (const EntityNotFoundException &e)
+    {
+        cout << "Remove twice: " << e.what() << " (expect Entity not found!)\n";
+    }
+
+    kg.addEntity("B");
+    cout << "Re-added B gets a fresh id: " << (kg.getEntityId("B") == 3 ? "yes" : "no") << " (expect yes)\n";
+    cout << "\n";
+}
+
+void tc_KG_023_concurrent_versions()
+{
+    cout << "tc_KG_023_concurrent_versions\n";
+    ConcurrentKnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addRelation("A", "B");
+    cout << "Pending: " << kg.pendingChanges() << " (expect 4)\n";
+    cout << "Unpublished size: " << kg.size() << " (expect 0)\n";
+
+    kg.publish();
+    shared_ptr<CSRGraph<string>> before = kg.snapshot();
+    kg.addRelation("B", "C");
+    kg.publish();
+    cout << "BFS(A): " << kg.bfs("A") << " (expect [A, B, C])\n";
+    cout << "Old version BFS(A): " << before->BFS("A") << " (expect [A, B])\n";
+    cout << "Reachable A->C: " << (kg.isReachable("A", "C") ? "true" : "false") << " (expect true)\n";
+
+    kg.setAutoPublish(1);
+    kg.removeEntity("B");
+    cout << "Auto-published: " << kg.getAllEntities().size() << " entities (expect 2)\n";
+
+    unsigned long long versions = kg.version();
+    kg.apply([](KnowledgeGraph &g)
+             {
+        g.addEntity("D");
+        g.addRelation("A", "D");
+        g.addRelation("D", "C"); });
+    cout << "Batch published once: " << (kg.version() == versions + 1 ? "yes" : "no") << " (expect yes)\n";
+    cout << "BFS(A): " << kg.bfs("A") << " (expect [A, D, C])\n";
+    cout << "\n";
+}
+
+void tc_KG_024_batch_queries()
+{
+    cout << "tc_KG_024_batch_queries\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addEntity("D");
+    kg.addRelation("A", "C");
+    kg.addRelation("A", "B");
+    kg.addRelation("B", "D");
+
+    vector<pair<string, string>> reach = {{"A", "D"}, {"D", "A"}, {"C", "C"}, {"B", "D"}};
+    vector<bool> answers = kg.isReachableBatch(reach, 2);
+    cout << "Reachable:";
+    for (bool answer : answers)
+        cout << " " << (answer ? "true" : "false");
+    cout << " (expect true false true true)\n";
+
+    vector<pair<string, int>> related = {{"A", 1}, {"A", 2}, {"D", 2}};
+    vector<vector<string>> found = kg.getRelatedEntitiesBatch(related);
+    cout << "Related(A, 1) = ";
+    printVec(found[0]);
+    cout << " (expect [B, C])\n";
+    cout << "Related(A, 2) = ";
+    printVec(found[1]);
+    cout << " (expect [B, C, D])\n";
+    cout << "Related(D, 2) = ";
+    printVec(found[2]);
+    cout << " (expect [])\n";
+    cout << "\n";
+}
+
+void tc_KG_025_khop()
+{
+    cout << "tc_KG_025_khop\n";
+    KnowledgeGraph kg;
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addEntity("D");
+    kg.addEntity("E");
+    kg.addRelation("A", "B", 1);
+    kg.addRelation("A", "C", 5);
+    kg.addRelation("B", "C", 1);
+    kg.addRelation("C", "D", 1);
+    kg.addRelation("D", "E", 1);
+
+    KHopOptions capped(3);
+    capped.perHopLimit = 1;
+    cout << "Capped(A, 3) = ";
+    printVec(kg.getRelatedEntities("A", capped));
+    cout << " (expect [B, C, D])\n";
+
+    KHopOptions budget(2);
+    budget.maxDistance = 2;
+    vector<EntityId> ids;
+    vector<double> distances;
+    kg.relatedIds(kg.getEntityId("A"), budget, ids, &distances);
+    cout << "Within 2 hops, weight 2:";
+    for (size_t i = 0; i < ids.size(); ++i)
+        cout << " " << kg.getEntityName(ids[i]) << "=" << distances[i];
+    cout << " (expect B=1 C=2)\n";
+    cout << "\n";
+}
+
+void tc_KG_026_query_cache()
+{
+    cout << "tc_KG_026_query_cache\n";
+    KnowledgeGraph kg;
+    kg.setQueryCacheCapacity(2);
+
+    kg.addEntity("A");
+    kg.addEntity("B");
+    kg.addEntity("C");
+    kg.addRelation("A", "B");
+
+    cout << "BFS(A) = " << kg.bfs("A") << " (expect [A, B])\n";
+    cout << "BFS(A) = " << kg.bfs("A") << " (expect [A, B])\n";
+    QueryCacheStats stats = kg.getQueryCacheStats();
+    cout << "Hits/misses: " << stats.hits << "/" << stats.misses << " (expect 1/1)\n";
+
+    kg.addRelation("B", "C");
+    cout << "BFS(A) = " << kg.bfs("A") << " (expect [A, B, C])\n";
+    stats = kg.getQueryCacheStats();
+    cout << "Invalidations: " << stats.invalidations << " (expect 1)\n";
+
+    kg.getRelatedEntities("A", 1);
+    kg.findCommonAncestors("B", "C");
+    stats = kg.getQueryCacheStats();
+    cout << "Entries/evictions: " << stats.entries << "/" << stats.evictions << " (expect 2/1)\n";
+
+    kg.findCommonAncestors("B", "C");
+    kg.bfs(kg.getEntityId("B"));
+    kg.bfs("B");
+    stats = kg.getQueryCacheStats();
+    cout << "Hits after bfs by id, then by name: " << stats.hits << " (expect 3)\n";
+    cout << "\n";
+}
+
+void tc_KG_027_topology_tracking()
+{
+    cout << "tc_KG_027_topology_tracking\n";
+    KnowledgeGraph kg;
+    kg.enableTopologyTracking();
+
+    kg.addEntity("C");
+    kg.addEntity("B");
+    kg.addEntity("A");
+    kg.addRelation("A", "B");
+    kg.addRelation("B", "C");
+    cout << "Order = ";
+    printVec(kg.topologicalOrder());
+    cout << " (expect [A, B, C])\n";
+
+    kg.addRelation("C", "A");
+    cout << "Acyclic: " << (kg.isAcyclic() ? "true" : "false") << " (expect false)\n";
+    cout << "A~C: " << (kg.stronglyConnected("A", "C") ? "true" : "false") << " (expect true)\n";
+
+    kg.removeRelation("C", "A");
+    cout << "Acyclic: " << (kg.isAcyclic() ? "true" : "false") << " (expect true)\n";
+    cout << "C->A: " << (kg.isReachable("C", "A") ? "true" : "false") << " (expect false)\n";
+
+    DGraphModel<int> model;
+    GraphChangeLog log;
+    model.addObserver(&log);
+    model.add(1);
+    model.add(2);
+    model.connect(1, 2);
+    model.disconnect(1, 2);
+    vector<GraphChange> changes;
+    log.drain(changes);
+    cout << "Logged changes: " << changes.size() << " (expect 4)\n";
+    cout << "\n";
+}
+
 int main()
 {
     cout << "Nigga";
@@ -298,6 +926,25 @@ int main()
     tc_KG_006_cycle_safety();
     tc_KG_007_commonAncestors_basic();
     tc_KG_008_basic_like_sample();
+    tc_KG_009_frozen_snapshot();
+    tc_KG_010_dfs_long_chain();
+    tc_KG_011_entity_ids();
+    tc_KG_012_bulk_load();
+    tc_KG_013_stream_load();
+    tc_KG_014_snapshot_roundtrip();
+    tc_KG_015_parallel_bfs();
+    tc_KG_016_bidirectional_reachability();
+    tc_KG_017_reachability_index();
+    tc_KG_018_shortest_path();
+    tc_KG_019_traversal_ids();
+    tc_KG_020_stream_dump();
+    tc_KG_021_relation_policy();
+    tc_KG_022_remove_entity();
+    tc_KG_023_concurrent_versions();
+    tc_KG_024_batch_queries();
+    tc_KG_025_khop();
+    tc_KG_026_query_cache();
+    tc_KG_027_topology_tracking();
     cout << "All test cases done.\n";
     return 0;
 }
@@ -27,6 +27,18 @@ public:
     explicit EdgeNotFoundException(const std::string& what_arg) : std::logic_error(what_arg) {}
 };
 
+class DuplicateEdgeException : public std::logic_error {
+public:
+    DuplicateEdgeException() : std::logic_error("Edge already exists!") {}
+    explicit DuplicateEdgeException(const std::string& what_arg) : std::logic_error(what_arg) {}
+};
+
+class NegativeWeightException : public std::logic_error {
+public:
+    NegativeWeightException() : std::logic_error("Negative edge weight!") {}
+    explicit NegativeWeightException(const std::string& what_arg) : std::logic_error(what_arg) {}
+};
+
 // =============================================================================
 // KNOWLEDGE GRAPH EXCEPTIONS
 // =============================================================================